@@ -0,0 +1,76 @@
+#include <tonc.h>
+
+#include "lzstream.h"
+
+/* bios lz77 against the streaming decoder and hlz, on the level textures.
+   build with make bench, results are printed on screen in cycles */
+
+#define BENCH_TILES ((void*)tile_mem[0])
+#define BENCH_MAP ((void*)se_mem[8])
+
+#define TTE_CBB 2
+#define TTE_SBB 31
+
+typedef struct {
+	const void *lz77, *hlz;
+	u32 lz77_size, hlz_size; /* sizes include padding */
+} bench_asset_t;
+
+extern const bench_asset_t bench_assets[3];
+
+static const char *const bench_names[3] = { "pal", "tiles", "map" };
+
+/* palette goes to ram, the bench text needs the real one */
+EWRAM_DATA u16 bench_pal_buf[256];
+
+static u32 checksum(const u16 *buf, u32 size) {
+	u32 sum = 0;
+	for (u32 i = 0; i < size / 2; i++) {
+		sum = (sum << 1 | sum >> 31) ^ buf[i];
+	}
+	return sum;
+}
+
+int main() {
+	void *const dsts[3] = { bench_pal_buf, BENCH_TILES, BENCH_MAP };
+
+	irq_init(NULL);
+	irq_add(II_VBLANK, NULL);
+
+	tte_init_se_default(0, BG_CBB(TTE_CBB) | BG_SBB(TTE_SBB));
+	REG_DISPCNT = DCNT_MODE0 | DCNT_BG0;
+	tte_printf("#{P:8,8}      raw  lz77  hlz\n");
+
+	for (int i = 0; i < 3; i++) {
+		const bench_asset_t *asset = &bench_assets[i];
+		u32 size = *(const u32*)asset->lz77 >> 8;
+		lz_stream_t s;
+
+		profile_start();
+		LZ77UnCompVram(asset->lz77, dsts[i]);
+		u32 bios = profile_stop();
+		u32 sum = checksum(dsts[i], size);
+
+		profile_start();
+		lz_init(&s, asset->lz77, dsts[i]);
+		lz_step(&s, size);
+		u32 stream = profile_stop();
+		int ok = (checksum(dsts[i], size) == sum);
+
+		profile_start();
+		hlz_decomp(asset->hlz, dsts[i]);
+		u32 hlz = profile_stop();
+		ok &= (checksum(dsts[i], size) == sum);
+
+		tte_printf("%-5s %5d %5d %5d\n", bench_names[i],
+			size, asset->lz77_size, asset->hlz_size);
+		tte_printf(" bios %d\n stream %d\n hlz %d %s\n", bios, stream, hlz,
+			ok ? "ok" : "BAD");
+	}
+
+	while (1) {
+		VBlankIntrWait();
+	}
+
+	return 0;
+}
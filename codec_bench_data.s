@@ -0,0 +1,30 @@
+@ level textures in both formats for codec_bench, matches bench_asset_t
+
+	.section .rodata
+	.align 2
+	.global bench_assets
+bench_assets:
+	.word .Lpal_lz77, .Lpal_hlz, .Lpal_hlz - .Lpal_lz77, .Ltiles_lz77 - .Lpal_hlz
+	.word .Ltiles_lz77, .Ltiles_hlz, .Ltiles_hlz - .Ltiles_lz77, .Lmap_lz77 - .Ltiles_hlz
+	.word .Lmap_lz77, .Lmap_hlz, .Lmap_hlz - .Lmap_lz77, .Lend - .Lmap_hlz
+
+	.align 2
+.Lpal_lz77:
+	.incbin "gfx/bgpal.pal.bin"
+	.align 2
+.Lpal_hlz:
+	.incbin "gfx/bgpal.pal.hlz"
+	.align 2
+.Ltiles_lz77:
+	.incbin "gfx/fanroom.img.bin"
+	.align 2
+.Ltiles_hlz:
+	.incbin "gfx/fanroom.img.hlz"
+	.align 2
+.Lmap_lz77:
+	.incbin "gfx/fanroom.map.bin"
+	.align 2
+.Lmap_hlz:
+	.incbin "gfx/fanroom.map.hlz"
+	.align 2
+.Lend:
@@ -0,0 +1,19 @@
+#include <tonc.h>
+
+#include "collide.h"
+#include "mode7.h"
+
+void col_fill_chunk(m7_level_t *level, int slot) {
+	const u8 *blocks = &level->blocks[slot * M7_CHUNK_W];
+
+	for (int y = 0; y < level->blocks_height; y++) {
+		u32 bits = 0;
+		for (int z = 0; z < M7_CHUNK_W; z++) {
+			if (blocks[z]) {
+				bits |= BIT(z);
+			}
+		}
+		level->solid[y * M7_WINDOW_CHUNKS + slot] = bits;
+		blocks += M7_WINDOW_W;
+	}
+}
@@ -0,0 +1,33 @@
+#ifndef COLLIDE_H_
+#define COLLIDE_H_
+
+#include <tonc.h>
+
+#include "mode7.h"
+
+/* solidity is one bit per block over the block window, a u16 per chunk
+   row (M7_CHUNK_W is 16). any non-empty block is solid. cells outside
+   the window, for objects away from the camera, are read from the rom
+   chunks instead, which is slower */
+#define COL_HIT_Y 1
+#define COL_HIT_Z 2
+#define COL_MAX_CELLS 4 /* longest move in blocks per axis and call */
+
+/* collision functions */
+void col_fill_chunk(m7_level_t *level, int slot);
+IWRAM_CODE int col_sweep(const m7_level_t *level, VECTOR *pos, const VECTOR *delta, FIXED radius);
+
+INLINE int col_solid(const m7_level_t *level, int y, int z) {
+	if ((u32)y >= (u32)level->blocks_height) {
+		return 1;
+	}
+	if ((u32)(z - level->window_z) >= M7_WINDOW_W) {
+		if ((u32)z >= (u32)level->blocks_width) {
+			return 1;
+		}
+		return level->chunks[((z / M7_CHUNK_W) * level->blocks_height + y) * M7_CHUNK_W + (z & (M7_CHUNK_W - 1))] != 0;
+	}
+	return (level->solid[y * M7_WINDOW_CHUNKS + ((z >> 4) & (M7_WINDOW_CHUNKS - 1))] >> (z & 15)) & 1;
+}
+
+#endif
@@ -0,0 +1,68 @@
+#include <tonc.h>
+
+#include "collide.h"
+#include "mode7.h"
+
+IWRAM_CODE static int
+column_solid(const m7_level_t *level, int z, int y0, int y1) {
+	for (int y = y0; y <= y1; y++) {
+		if (col_solid(level, y, z)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+IWRAM_CODE static int
+row_solid(const m7_level_t *level, int y, int z0, int z1) {
+	for (int z = z0; z <= z1; z++) {
+		if (col_solid(level, y, z)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* moves the leading edge of [c - r, c + r) by d, stopping at the first
+   blocked line of cells entered. returns the new center */
+IWRAM_CODE static FIXED
+sweep_axis(const m7_level_t *level, int axis_z, FIXED c, FIXED d, FIXED r, int lo, int hi, int *hit) {
+	d = CLAMP(d, -int2fx(COL_MAX_CELLS), int2fx(COL_MAX_CELLS));
+
+	if (d > 0) {
+		FIXED edge = c + r;
+		int last = (edge + d - 1) >> FIX_SHIFT;
+		for (int cell = ((edge - 1) >> FIX_SHIFT) + 1; cell <= last; cell++) {
+			if (axis_z ? column_solid(level, cell, lo, hi) : row_solid(level, cell, lo, hi)) {
+				*hit = 1;
+				return int2fx(cell) - r;
+			}
+		}
+	} else if (d < 0) {
+		FIXED edge = c - r;
+		int last = (edge + d) >> FIX_SHIFT;
+		for (int cell = (edge >> FIX_SHIFT) - 1; cell >= last; cell--) {
+			if (axis_z ? column_solid(level, cell, lo, hi) : row_solid(level, cell, lo, hi)) {
+				*hit = 1;
+				return int2fx(cell + 1) + r;
+			}
+		}
+	}
+
+	return c + d;
+}
+
+/* moves pos by delta in y / z as a box of half size radius. blocked axes
+   stop flush with the wall while the other keeps going, which slides */
+IWRAM_CODE int
+col_sweep(const m7_level_t *level, VECTOR *pos, const VECTOR *delta, FIXED radius) {
+	int hit_y = 0, hit_z = 0;
+
+	/* y against the rows spanned in z, then z with the new y */
+	pos->y = sweep_axis(level, 0, pos->y, delta->y, radius,
+		(pos->z - radius) >> FIX_SHIFT, (pos->z + radius - 1) >> FIX_SHIFT, &hit_y);
+	pos->z = sweep_axis(level, 1, pos->z, delta->z, radius,
+		(pos->y - radius) >> FIX_SHIFT, (pos->y + radius - 1) >> FIX_SHIFT, &hit_z);
+
+	return (hit_y ? COL_HIT_Y : 0) | (hit_z ? COL_HIT_Z : 0);
+}
@@ -0,0 +1,148 @@
+#include <tonc.h>
+
+#include "fly.h"
+
+#define FLY_KEY(x, y, z, theta, ticks) { (x) << 8, (y) << 8, (z) << 8, (theta), (ticks) }
+
+/* fan room, 16 wide, blocks 1-14 high and 1-30 along. the diagonal is
+   floor code 3 at z 17-23 */
+
+/* down the whole room and back, the longest rays there are */
+static const fly_key_t fly_corridor[] = {
+	FLY_KEY(8, 2, 2, 0x0000, 0),
+	FLY_KEY(8, 2, 29, 0x0000, 240),
+	FLY_KEY(8, 2, 29, 0x8000, 60),
+	FLY_KEY(8, 2, 2, 0x8000, 240),
+};
+
+/* along the diagonal, looking across it both ways */
+static const fly_key_t fly_diagonal[] = {
+	FLY_KEY(4, 6, 12, 0xE000, 0),
+	FLY_KEY(8, 6, 18, 0x2000, 120),
+	FLY_KEY(12, 10, 26, 0xE000, 120),
+	FLY_KEY(8, 3, 14, 0x1000, 120),
+};
+
+/* standing still, pitching right round */
+static const fly_key_t fly_steep[] = {
+	FLY_KEY(8, 7, 15, 0x0000, 0),
+	FLY_KEY(8, 7, 15, 0x4000, 60),
+	FLY_KEY(8, 7, 15, 0x8000, 60),
+	FLY_KEY(8, 7, 15, 0xC000, 60),
+	FLY_KEY(8, 7, 15, 0x0000, 60),
+};
+
+#define FLY_PATH(name, keys) { name, keys, sizeof(keys) / sizeof(keys[0]) }
+
+static const fly_path_t fly_paths[] = {
+	FLY_PATH("corridor", fly_corridor),
+	FLY_PATH("diagonal", fly_diagonal),
+	FLY_PATH("steep", fly_steep),
+};
+
+#define FLY_PATH_COUNT (sizeof(fly_paths) / sizeof(fly_paths[0]))
+
+static struct {
+	int running;
+	int path, key, tick;
+} fly;
+
+static const char fly_hex[16] = "0123456789abcdef";
+
+static char *fly_str(char *dst, const char *src) {
+	while (*src) {
+		*dst++ = *src++;
+	}
+	return dst;
+}
+
+static char *fly_num(char *dst, u32 v) {
+	int shift = 28;
+	while ((shift > 0) && ((v >> shift) == 0)) {
+		shift -= 4;
+	}
+
+	dst = fly_str(dst, "0x");
+	for (; shift >= 0; shift -= 4) {
+		*dst++ = fly_hex[(v >> shift) & 15];
+	}
+	return dst;
+}
+
+/* "M7FLY path <n> <name>", paths count from 1 like the trace records */
+static void fly_log_path() {
+	char *dst = fly_str(nocash_buffer, "M7FLY ");
+	if (fly.path < FLY_PATH_COUNT) {
+		dst = fly_str(dst, "path ");
+		*dst++ = '1' + fly.path;
+		*dst++ = ' ';
+		dst = fly_str(dst, fly_paths[fly.path].name);
+	} else {
+		dst = fly_str(dst, "done");
+	}
+	*dst = '\0';
+	nocash_message();
+}
+
+void fly_start() {
+	if (fly.running) {
+		return;
+	}
+
+	fly.running = 1;
+	fly.path = fly.key = fly.tick = 0;
+	fly_log_path();
+}
+
+/* sets the camera for this tick */
+void fly_tick(m7_cam_t *cam) {
+	/* wait on the first pose until started, stay on the last when done */
+	if (!fly.running) {
+		const fly_key_t *key = &fly_paths[0].keys[0];
+		cam->pos.x = key->x;
+		cam->pos.y = key->y;
+		cam->pos.z = key->z;
+		cam->theta = key->theta;
+		return;
+	}
+	if (fly.path >= FLY_PATH_COUNT) {
+		return;
+	}
+
+	const fly_path_t *path = &fly_paths[fly.path];
+	const fly_key_t *a = &path->keys[fly.key], *b = &path->keys[fly.key + 1];
+	int alpha = (fly.tick << 8) / b->ticks;
+
+	cam->pos.x = a->x + (((b->x - a->x) * alpha) >> 8);
+	cam->pos.y = a->y + (((b->y - a->y) * alpha) >> 8);
+	cam->pos.z = a->z + (((b->z - a->z) * alpha) >> 8);
+	cam->theta = (a->theta + ((((s16)(b->theta - a->theta)) * alpha) >> 8)) & 0xFFFF;
+	TR_SET(path, fly.path + 1);
+
+	/* on to the next key, then the next path */
+	if (++fly.tick < b->ticks) {
+		return;
+	}
+	fly.tick = 0;
+	if (++fly.key < path->count - 1) {
+		return;
+	}
+	fly.key = 0;
+	fly.path++;
+	fly_log_path();
+}
+
+/* "M7FLY { x, y, z, theta, 1 },", a fly_key_t a tick */
+void fly_record(const m7_cam_t *cam) {
+	char *dst = fly_str(nocash_buffer, "M7FLY { ");
+	dst = fly_num(dst, cam->pos.x);
+	dst = fly_str(dst, ", ");
+	dst = fly_num(dst, cam->pos.y);
+	dst = fly_str(dst, ", ");
+	dst = fly_num(dst, cam->pos.z);
+	dst = fly_str(dst, ", ");
+	dst = fly_num(dst, cam->theta & 0xFFFF);
+	dst = fly_str(dst, ", 1 },");
+	*dst = '\0';
+	nocash_message();
+}
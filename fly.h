@@ -0,0 +1,41 @@
+#ifndef FLY_H_
+#define FLY_H_
+
+#include <tonc.h>
+
+#include "mode7.h"
+#include "trace.h"
+
+/* benchmark flythroughs. with FLY_ENABLED the camera follows the paths in
+   fly.c instead of the keys, one sim tick a frame so every build renders
+   the same poses, and each frame's trace record is tagged with the path.
+   no input is needed: make flybench EMU=<headless emulator> builds and
+   runs it, keeps the debug log until "M7FLY done" and prints per path
+   percentiles, against an earlier log with BASE=<log>.
+   FLY_RECORD logs the camera every tick as keys to paste into a path */
+// #define FLY_ENABLED
+// #define FLY_RECORD
+
+#if defined(FLY_ENABLED) && !defined(TRACE_ENABLED)
+#error "FLY_ENABLED needs TRACE_ENABLED for the frame records"
+#endif
+
+/* camera pose, reached ticks after the previous key */
+typedef struct {
+	s32 x, y, z; /* .8f */
+	u16 theta;
+	u16 ticks;
+} fly_key_t;
+
+typedef struct {
+	const char *name;
+	const fly_key_t *keys;
+	int count;
+} fly_path_t;
+
+/* fly functions */
+void fly_start();
+void fly_tick(m7_cam_t *cam);
+void fly_record(const m7_cam_t *cam);
+
+#endif
@@ -0,0 +1,107 @@
+# Packs material images into one affine background: 8bpp tiles shared
+# between materials and a 128x128 tile map.
+#
+# usage: atlas.py out_prefix material.png ...
+#
+# Images are 8 bit indexed pngs on the background palette, sized in whole
+# tiles. Writes out_prefix.img.raw (tiles), out_prefix.map.raw (map) and
+# out_prefix.regions, one "name x y width height" line per image in pixels,
+# named after the file. tmx2level.py reads the regions for material origins.
+
+import os
+import struct
+import sys
+import zlib
+
+MAP_TILES = 128
+MAX_TILES = 256 # affine maps address 256 tiles
+
+def read_png(path):
+	with open(path, 'rb') as f:
+		data = f.read()
+	assert data[:8] == b'\x89PNG\r\n\x1a\n', '%s: not a png' % path
+
+	pos, idat = 8, b''
+	while pos < len(data):
+		length, kind = struct.unpack('>I4s', data[pos:pos + 8])
+		body = data[pos + 8:pos + 8 + length]
+		if kind == b'IHDR':
+			width, height, depth, color, _, _, interlace = struct.unpack('>IIBBBBB', body)
+			assert depth == 8 and color == 3 and not interlace, '%s: needs 8 bit indexed' % path
+		elif kind == b'IDAT':
+			idat += body
+		pos += length + 12
+
+	raw = zlib.decompress(idat)
+	rows, prev = [], bytearray(width)
+	for y in range(height):
+		line = raw[y * (width + 1):(y + 1) * (width + 1)]
+		kind, row = line[0], bytearray(line[1:])
+		for x in range(width):
+			a = row[x - 1] if x else 0
+			b = prev[x]
+			c = prev[x - 1] if x else 0
+			if kind == 1:
+				row[x] = (row[x] + a) & 0xFF
+			elif kind == 2:
+				row[x] = (row[x] + b) & 0xFF
+			elif kind == 3:
+				row[x] = (row[x] + (a + b) // 2) & 0xFF
+			elif kind == 4:
+				p = a + b - c
+				pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+				pred = a if pa <= pb and pa <= pc else (b if pb <= pc else c)
+				row[x] = (row[x] + pred) & 0xFF
+		rows.append(bytes(row))
+		prev = row
+	return width, height, rows
+
+def shelf_pack(sizes):
+	# tallest first, left to right along shelves
+	order = sorted(range(len(sizes)), key=lambda i: -sizes[i][1])
+	places = [None] * len(sizes)
+	x = y = shelf = 0
+	for i in order:
+		w, h = sizes[i]
+		if x + w > MAP_TILES:
+			x, y = 0, y + shelf
+			shelf = 0
+		assert y + h <= MAP_TILES, 'materials do not fit in the map'
+		places[i] = (x, y)
+		x += w
+		shelf = max(shelf, h)
+	return places
+
+out_prefix, paths = sys.argv[1], sys.argv[2:]
+
+images = [read_png(p) for p in paths]
+for path, (w, h, _) in zip(paths, images):
+	assert w % 8 == 0 and h % 8 == 0, '%s: not whole tiles' % path
+places = shelf_pack([(w // 8, h // 8) for w, h, _ in images])
+
+# tile 0 stays blank for the unused map
+tiles = [bytes(64)]
+tile_ids = {tiles[0]: 0}
+tile_map = bytearray(MAP_TILES * MAP_TILES)
+
+for (w, h, rows), (tx, ty) in zip(images, places):
+	for y in range(h // 8):
+		for x in range(w // 8):
+			tile = b''.join(rows[y * 8 + r][x * 8:x * 8 + 8] for r in range(8))
+			if tile not in tile_ids:
+				tile_ids[tile] = len(tiles)
+				tiles.append(tile)
+			tile_map[(ty + y) * MAP_TILES + tx + x] = tile_ids[tile]
+
+assert len(tiles) <= MAX_TILES, '%d unique tiles, affine limit is %d' % (len(tiles), MAX_TILES)
+
+with open(out_prefix + '.img.raw', 'wb') as f:
+	f.write(b''.join(tiles))
+with open(out_prefix + '.map.raw', 'wb') as f:
+	f.write(tile_map)
+with open(out_prefix + '.regions', 'w') as f:
+	for path, (w, h, _), (tx, ty) in zip(paths, images, places):
+		name = os.path.splitext(os.path.basename(path))[0]
+		f.write('%s %d %d %d %d\n' % (name, tx * 8, ty * 8, w, h))
+
+print('%s: %d materials, %d tiles' % (out_prefix, len(images), len(tiles)))
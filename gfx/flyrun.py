@@ -0,0 +1,59 @@
+# Runs a flythrough rom (built with TRACE_ENABLED and FLY_ENABLED) under a
+# headless emulator and keeps its debug log, so two builds can be compared
+# without anyone at the keys. make flybench drives it.
+#
+# usage: flyrun.py [--timeout seconds] log emulator [args ...] rom
+#
+# The emulator command has to print the rom's no$gba debug messages to
+# stdout or stderr. Everything it prints goes to the log until a moment
+# after "M7FLY done", enough for the last trace records to be flushed, then
+# the emulator is stopped. Fails if it quits first or the timeout runs out.
+
+import queue
+import subprocess
+import sys
+import threading
+import time
+
+GRACE = 1.0 # seconds kept after the last path, for the records behind it
+
+args = sys.argv[1:]
+timeout = 300.0
+if args and args[0] == '--timeout':
+	timeout = float(args[1])
+	args = args[2:]
+if len(args) < 2:
+	sys.exit('usage: flyrun.py [--timeout seconds] log emulator [args ...] rom')
+log_path, command = args[0], args[1:]
+
+emu = subprocess.Popen(command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+
+# read on a thread, so the deadline holds while the emulator is quiet
+lines = queue.Queue()
+def read():
+	for line in emu.stdout:
+		lines.put(line)
+	lines.put(None)
+threading.Thread(target=read, daemon=True).start()
+
+deadline = time.time() + timeout
+done = False
+status = 'timed out after %gs' % timeout
+with open(log_path, 'wb') as log:
+	while time.time() < deadline:
+		try:
+			line = lines.get(timeout=deadline - time.time())
+		except queue.Empty:
+			break
+		if line is None:
+			status = 'emulator quit before the flythrough finished'
+			break
+		log.write(line)
+		if not done and b'M7FLY done' in line:
+			done = True
+			deadline = time.time() + GRACE
+
+emu.kill()
+emu.wait()
+if not done:
+	sys.exit('%s: %s, log in %s' % (' '.join(command), status, log_path))
@@ -0,0 +1,187 @@
+# Compresses a binary into the hlz format read by lzstream.h.
+#
+# usage: hlz.py [--lz77] in.bin out.hlz
+#
+# hlz is lz4-like, but counts lengths and offsets in halfwords so the decoder
+# only ever does 16 bit loads and stores, which vram needs anyway. Literals
+# sit in their own halfword aligned stream after the control bytes.
+#
+#   u32 header   size << 8 | 0x40, size in bytes
+#   u32 literals byte offset of the literal stream from the header
+#   control      per sequence: token (literals << 4 | match - 2), extra
+#                length bytes when a nibble is 15 (lz4 style), u16 offset
+#   literals     halfwords
+#
+# The last sequence is literals only. With --lz77 the input is bios lz77
+# (as written by grit -Zl) and is unpacked first.
+
+import sys
+
+HLZ_TYPE = 0x40
+MIN_MATCH = 2 # halfwords
+MAX_OFFSET = 0xFFFF
+CHAIN_DEPTH = 64
+
+def lz77_decode(data):
+	assert data[0] == 0x10, 'not bios lz77 data'
+	size = data[1] | (data[2] << 8) | (data[3] << 16)
+	out = bytearray()
+	i = 4
+	while len(out) < size:
+		flags = data[i]
+		i += 1
+		for bit in range(8):
+			if len(out) >= size:
+				break
+			if flags & (0x80 >> bit):
+				length = (data[i] >> 4) + 3
+				disp = (((data[i] & 0xF) << 8) | data[i + 1]) + 1
+				i += 2
+				for _ in range(length):
+					out.append(out[-disp])
+			else:
+				out.append(data[i])
+				i += 1
+	return bytes(out[:size])
+
+def length_bytes(n):
+	out = bytearray()
+	while n >= 255:
+		out.append(255)
+		n -= 255
+	out.append(n)
+	return out
+
+def encode(data):
+	size = len(data)
+	if size & 1:
+		data = data + b'\0'
+	hw = [data[i] | (data[i + 1] << 8) for i in range(0, len(data), 2)]
+	n = len(hw)
+
+	ctl = bytearray()
+	lits = []
+	head = {}
+	prev = [-1] * n
+
+	def insert(i):
+		if i + 1 < n:
+			key = (hw[i], hw[i + 1])
+			prev[i] = head.get(key, -1)
+			head[key] = i
+
+	def find(i):
+		if i + 1 >= n:
+			return 0, 0
+		best_len, best_ofs = 0, 0
+		j = head.get((hw[i], hw[i + 1]), -1)
+		depth = CHAIN_DEPTH
+		while j >= 0 and i - j <= MAX_OFFSET and depth > 0:
+			k = 0
+			while i + k < n and hw[j + k] == hw[i + k]:
+				k += 1
+			if k > best_len:
+				best_len, best_ofs = k, i - j
+			j = prev[j]
+			depth -= 1
+		return best_len, best_ofs
+
+	def emit(lit_start, lit_end, match_len, ofs):
+		lit_len = lit_end - lit_start
+		m = match_len - MIN_MATCH if match_len else 0
+		ctl.append((min(lit_len, 15) << 4) | min(m, 15))
+		if lit_len >= 15:
+			ctl.extend(length_bytes(lit_len - 15))
+		lits.extend(hw[lit_start:lit_end])
+		if match_len:
+			ctl.append(ofs & 0xFF)
+			ctl.append(ofs >> 8)
+			if m >= 15:
+				ctl.extend(length_bytes(m - 15))
+
+	i, lit_start = 0, 0
+	while i < n:
+		length, ofs = find(i)
+		if length >= MIN_MATCH:
+			# lazy: take a literal if the next position matches longer
+			insert(i)
+			next_len, next_ofs = find(i + 1)
+			if next_len > length + 1:
+				i += 1
+				continue
+			emit(lit_start, i, length, ofs)
+			for k in range(1, length):
+				insert(i + k)
+			i += length
+			lit_start = i
+		else:
+			insert(i)
+			i += 1
+	emit(lit_start, n, 0, 0)
+
+	while len(ctl) & 1:
+		ctl.append(0)
+	out = bytearray()
+	out += (size << 8 | HLZ_TYPE).to_bytes(4, 'little')
+	out += (8 + len(ctl)).to_bytes(4, 'little')
+	out += ctl
+	for h in lits:
+		out += h.to_bytes(2, 'little')
+	while len(out) & 3:
+		out.append(0)
+	return bytes(out)
+
+def decode(data):
+	size = int.from_bytes(data[0:4], 'little') >> 8
+	c = 8
+	l = int.from_bytes(data[4:8], 'little')
+	out = []
+	end = (size + 1) // 2
+	while True:
+		token = data[c]
+		c += 1
+		length = token >> 4
+		if length == 15:
+			while True:
+				b = data[c]
+				c += 1
+				length += b
+				if b != 255:
+					break
+		for _ in range(length):
+			out.append(data[l] | (data[l + 1] << 8))
+			l += 2
+		if len(out) >= end:
+			break
+		ofs = data[c] | (data[c + 1] << 8)
+		c += 2
+		length = token & 15
+		if length == 15:
+			while True:
+				b = data[c]
+				c += 1
+				length += b
+				if b != 255:
+					break
+		for _ in range(length + MIN_MATCH):
+			out.append(out[-ofs])
+	return b''.join(h.to_bytes(2, 'little') for h in out)[:size]
+
+args = sys.argv[1:]
+from_lz77 = '--lz77' in args
+in_path, out_path = [a for a in args if a != '--lz77']
+
+with open(in_path, 'rb') as f:
+	src = f.read()
+raw = lz77_decode(src) if from_lz77 else src
+
+packed = encode(raw)
+assert decode(packed) == raw, 'hlz round trip failed'
+
+with open(out_path, 'wb') as f:
+	f.write(packed)
+
+stats = '%s: raw %d' % (out_path, len(raw))
+if from_lz77:
+	stats += ', lz77 %d' % len(src)
+print(stats + ', hlz %d' % len(packed))
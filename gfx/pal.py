@@ -0,0 +1,31 @@
+# Converts the palette of an indexed png to raw BGR555, one halfword per
+# entry, the same as grit's -p output. For builds without grit.
+#
+# usage: pal.py in.png out.raw
+
+import struct
+import sys
+
+def read_plte(path):
+	with open(path, 'rb') as f:
+		data = f.read()
+	assert data[:8] == b'\x89PNG\r\n\x1a\n', '%s: not a png' % path
+
+	pos = 8
+	while pos < len(data):
+		length, kind = struct.unpack('>I4s', data[pos:pos + 8])
+		if kind == b'PLTE':
+			return data[pos + 8:pos + 8 + length]
+		pos += length + 12
+	sys.exit('%s: no palette' % path)
+
+in_path, out_path = sys.argv[1], sys.argv[2]
+
+plte = read_plte(in_path)
+out = bytearray()
+for i in range(0, len(plte), 3):
+	r, g, b = plte[i], plte[i + 1], plte[i + 2]
+	out += struct.pack('<H', (r >> 3) | ((g >> 3) << 5) | ((b >> 3) << 10))
+
+with open(out_path, 'wb') as f:
+	f.write(out)
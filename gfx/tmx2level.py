@@ -0,0 +1,233 @@
+# Compiles a Tiled level into a mode7 level container (m7_level_hdr_t).
+#
+# usage: tmx2level.py level.tmx out_prefix
+#
+# The map is the y/z block grid. Layers "floor" and "wall" hold block codes
+# (tile id in the blocks tileset) and an "extents" property with a
+# start,end pair per row. An "extent_runs" property overrides runs of
+# blocks: y,z_start,z_end,start,end groups separated by ';'. Extents are
+# deduplicated into a table of at most 256 and each block gets an index
+# into it. Block maps are stored as chunks of M7_CHUNK_W
+# columns, the width padded out with end blocks. Objects in the "objects"
+# group become spawns.
+# Map properties "tiles" and "pal" name the grit binaries packed in after.
+#
+# Tiles in the blocks tileset are materials: properties "n", "s", "e" and
+# "w" give the texture origin of that side, either x,y or the name of a
+# region packed by atlas.py (map property "atlas" names its output), both
+# absolute in the texture. Unset sides default to the shared layout (floor
+# at 0,0, walls at texture_width, ceiling at texture_height). Each layer
+# gets its own table; in the wall layer's, the defaults sit texture_height
+# further down unless it is streamed.
+#
+# Levels longer than the affine map give both layers a "strip" property:
+# a raw u8 map with texture_width / 4 tiles per row, floor then ceiling
+# columns, rows in z order. These are streamed into a ring in the map.
+
+import os
+import re
+import sys
+import xml.etree.ElementTree as ET
+
+# engine constants, read from mode7.h so the fixed point math matches
+defines = {}
+with open(os.path.join(os.path.dirname(__file__), '..', 'mode7.h')) as header:
+	for line in header:
+		m = re.match(r'#define\s+(\w+)\s+\(?(-?\d+)\)?', line)
+		if m:
+			defines[m.group(1)] = int(m.group(2))
+
+PIX_PER_BLOCK = defines['PIX_PER_BLOCK']
+FRAME_TILES = defines['M7_OBJ_FRAME_TILES']
+CHUNK_W = defines['M7_CHUNK_W']
+BLOCK_END = defines['M7_BLOCK_END']
+MAX_WIDTH = defines['M7_MAX_WIDTH']
+MAX_HEIGHT = defines['M7_MAX_HEIGHT']
+
+def int2fx(i):
+	return i << 8
+
+def fxmul(a, b):
+	return (a * b) >> 8
+
+def fxdiv(a, b):
+	return int((a * 256) / b)
+
+FOV = fxdiv(int2fx(defines['M7_TOP']), int2fx(defines['M7_D']))
+
+def props(elem):
+	out = {}
+	for p in elem.findall('properties/property'):
+		value = p.get('value')
+		out[p.get('name')] = int(value) if p.get('type') == 'int' else value
+	return out
+
+tmx_path, out_prefix = sys.argv[1], sys.argv[2]
+name = os.path.basename(out_prefix)
+
+tmx = ET.parse(tmx_path).getroot()
+width, height = int(tmx.get('width')), int(tmx.get('height'))
+chunk_count = (width + CHUNK_W - 1) // CHUNK_W
+assert chunk_count * CHUNK_W <= MAX_WIDTH, '%s: wider than M7_MAX_WIDTH' % tmx_path
+assert height <= MAX_HEIGHT, '%s: taller than M7_MAX_HEIGHT' % tmx_path
+map_props = props(tmx)
+tileset = tmx.find('tileset')
+firstgid = int(tileset.get('firstgid'))
+
+texture_width = map_props['texture_width']
+texture_height = map_props['texture_height']
+a_x_range = int2fx(texture_width // height)
+
+layers = {}
+for layer in tmx.findall('layer'):
+	gids = [int(g) for g in layer.find('data').text.split(',')]
+	rows = [[0 if g == 0 else g - firstgid for g in gids[y * width:(y + 1) * width]] for y in range(height)]
+	rows = [row + [BLOCK_END] * (chunk_count * CHUNK_W - width) for row in rows]
+
+	# chunk major, then row major inside each chunk
+	blocks = []
+	for c in range(chunk_count):
+		for row in rows:
+			blocks.extend(row[c * CHUNK_W:(c + 1) * CHUNK_W])
+
+	# [start, end) in x for every block, rows first then runs on top
+	ext = [int(e) for e in props(layer)['extents'].split(',')]
+	spans = [[(ext[y * 2], ext[y * 2 + 1])] * (chunk_count * CHUNK_W) for y in range(height)]
+	for run in filter(None, props(layer).get('extent_runs', '').split(';')):
+		y, z_start, z_end, start, end = [int(v) for v in run.split(',')]
+		for z in range(z_start, z_end):
+			spans[y][z] = (start, end)
+
+	# fov scaled (width, offset) table, one id per block
+	extents, extent_ids = [], []
+	for row in spans:
+		for start, end in row:
+			entry = (fxmul(int2fx((end - start) * PIX_PER_BLOCK), FOV), (a_x_range + int2fx(start)) // 2)
+			if entry not in extents:
+				extents.append(entry)
+			extent_ids.append(extents.index(entry))
+	assert len(extents) <= 256, '%s: too many distinct extents' % layer.get('name')
+
+	layers[layer.get('name')] = (blocks, extents, extent_ids, props(layer).get('strip'))
+
+regions = {}
+if 'atlas' in map_props:
+	with open(os.path.join(os.path.dirname(tmx_path), map_props['atlas'] + '.regions')) as f:
+		for line in f:
+			region, x, y, _, _ = line.split()
+			regions[region] = (int(x), int(y))
+
+def origin(value):
+	if value in regions:
+		return regions[value]
+	return tuple(int(v) for v in value.split(','))
+
+# raycast side order: north, south, east, west
+default = {'n': (texture_height, 0), 's': (0, 0), 'e': (texture_width, 0), 'w': (texture_width, 0)}
+materials = []
+for code in range(int(tileset.get('tilecount'))):
+	tile = tileset.find("tile[@id='%d']" % code)
+	p = props(tile) if tile is not None else {}
+	# None marks a side on the default layout, placed per layer below
+	materials.append([origin(p[side]) if side in p else None for side in 'nsew'])
+
+spawns = []
+for obj in tmx.findall("objectgroup[@name='objects']/object"):
+	p = props(obj)
+	tw, th = int(tmx.get('tilewidth')), int(tmx.get('tileheight'))
+	spawns.append({
+		'x': int2fx(p['height']),
+		'y': int(int2fx(1) * float(obj.get('y')) / th),
+		'z': int(int2fx(1) * float(obj.get('x')) / tw),
+		'anchor': (p.get('anchor_x', 16), p.get('anchor_y', 16)),
+		'phi': (p.get('phi', 0) + 0x8000) % 0x10000 - 0x8000, # s16
+		'sheet': p['sheet'],
+		'first': p['first'],
+		'frames': p['frames'],
+	})
+
+def directive(kind, values, per_line):
+	lines = []
+	for i in range(0, len(values), per_line):
+		lines.append('\t.%s %s' % (kind, ','.join(str(v) for v in values[i:i + per_line])))
+	return '\n'.join(lines) + '\n'
+
+gfx_dir = os.path.dirname(tmx_path)
+sections = ['floor_blocks', 'wall_blocks',
+	'floor_extents', 'floor_extent_ids',
+	'wall_extents', 'wall_extent_ids',
+	'spawns', 'floor_materials', 'wall_materials', 'pal', 'tiles', 'map',
+	'floor_strip', 'wall_strip']
+
+strip_rows = 0
+for layer_name in ('floor', 'wall'):
+	strip = layers[layer_name][3]
+	if strip:
+		size = os.path.getsize(os.path.join(gfx_dir, strip))
+		strip_rows = size // (texture_width // 4)
+
+with open(out_prefix + '.s', 'w') as out:
+	out.write('@ generated by tmx2level.py from %s, do not edit\n\n' % os.path.basename(tmx_path))
+	out.write('\t.section .rodata\n\t.align 2\n\t.global %s\n' % name)
+
+	# header, matches m7_level_hdr_t
+	out.write('%s:\n' % name)
+	out.write('\t.ascii "M7LV"\n')
+	out.write('\t.hword %d, .Lheader_end - %s\n' % (defines['M7_LEVEL_VERSION'], name))
+	out.write('\t.hword %d, %d\n' % (chunk_count * CHUNK_W, height))
+	out.write('\t.hword %d, %d\n' % (texture_width, texture_height))
+	out.write('\t.hword %d, %d\n' % (len(spawns), strip_rows))
+	for section in sections:
+		if section.endswith('_strip') and not layers[section[:-6]][3]:
+			out.write('\t.word 0\n')
+			continue
+		out.write('\t.word .L%s - %s\n' % (section, name))
+	out.write('.Lheader_end:\n\n')
+
+	for layer_name in ('floor', 'wall'):
+		out.write('\t.align 2\n.L%s_blocks:\n' % layer_name)
+		out.write(directive('byte', layers[layer_name][0], CHUNK_W))
+	for layer_name in ('floor', 'wall'):
+		out.write('\t.align 2\n.L%s_extents:\n' % layer_name)
+		for ext_width, ext_off in layers[layer_name][1]:
+			out.write('\t.word %d, %d\n' % (ext_width, ext_off))
+		out.write('\t.align 2\n.L%s_extent_ids:\n' % layer_name)
+		out.write(directive('byte', layers[layer_name][2], chunk_count * CHUNK_W))
+
+	# spawns, matches m7_spawn_t
+	out.write('\t.align 2\n.Lspawns:\n')
+	for s in spawns:
+		out.write('\t.word %d, %d, %d\n' % (s['x'], s['y'], s['z']))
+		out.write('\t.hword %d, %d, %d\n' % (s['anchor'][0], s['anchor'][1], s['phi']))
+		out.write('\t.byte %d, %d\n' % (s['sheet'], s['frames']))
+		out.write('\t.hword %d, 0\n' % s['first'])
+
+	# materials, matches m7_material_t
+	for layer_name in ('floor', 'wall'):
+		layer_y = texture_height if (layer_name == 'wall' and not layers['wall'][3]) else 0
+		out.write('\t.align 2\n.L%s_materials:\n' % layer_name)
+		for sides in materials:
+			sides = [(default[side][0], default[side][1] + layer_y) if o is None else o
+				for side, o in zip('nsew', sides)]
+			out.write('\t.hword %s\n' % ', '.join('%d, %d' % o for o in sides))
+
+	# grit output, repacked by hlz.py
+	for section, path in (
+			('pal', '%s.pal.hlz' % map_props['pal']),
+			('tiles', '%s.img.hlz' % map_props['tiles']),
+			('map', '%s.map.hlz' % map_props['tiles'])):
+		out.write('\t.align 2\n.L%s:\n\t.incbin "%s"\n' % (section, os.path.join(gfx_dir, path)))
+
+	# uncompressed, read a few rows at a time
+	for layer_name in ('floor', 'wall'):
+		strip = layers[layer_name][3]
+		if strip:
+			out.write('\t.align 2\n.L%s_strip:\n\t.incbin "%s"\n' % (layer_name, os.path.join(gfx_dir, strip)))
+
+with open(out_prefix + '.h', 'w') as out:
+	guard = '%s_H_' % name.upper()
+	out.write('/* generated by tmx2level.py from %s, do not edit */\n\n' % os.path.basename(tmx_path))
+	out.write('#ifndef %s\n#define %s\n\n' % (guard, guard))
+	out.write('#include "../mode7.h"\n\n')
+	out.write('extern const m7_level_hdr_t %s;\n\n' % name)
+	out.write('#endif\n')
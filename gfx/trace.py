@@ -0,0 +1,135 @@
+# Decodes frame records written by trace.h.
+#
+# usage: trace.py [--csv | --folded | --summary] input
+#        trace.py --percentiles input [other]
+#
+# The input is either a memory dump holding the ewram ring (found by its
+# "M7TR" magic) or a no$gba debug log, where tr_flush prints one record per
+# line as "M7TR " and the record bytes in hex.
+#
+#   --csv      one row per frame, phase lengths in cycles (default)
+#   --folded   phase totals as folded stacks, for flamegraph.pl
+#   --summary  min / avg / max and share of the frame per phase
+#   --percentiles  p50 / p90 / p99 / max per fly.h path, for frames of a
+#              flythrough. a second input, say a log of another build, adds
+#              the change from the first to it
+#
+# Phases run from one stamp to the next: vblank work, sim, prep (block
+# window and tables), objects (and hud, and race-the-beam prep after it).
+
+import re
+import struct
+import sys
+
+MAGIC = b'M7TR'
+VERSION = 3
+HEADER = struct.Struct('<4sHHHHI')
+RECORD = struct.Struct('<I5IHHBBBx')
+PHASES = ['vblank', 'sim', 'prep', 'objects']
+
+def records_from_dump(data):
+	pos = data.find(MAGIC)
+	while pos >= 0:
+		_, version, size, ring, _, head = HEADER.unpack_from(data, pos)
+		if version == VERSION and size == RECORD.size:
+			break
+		pos = data.find(MAGIC, pos + 1)
+	assert pos >= 0, 'no trace ring in dump'
+
+	base = pos + HEADER.size
+	count = min(head, ring)
+	out = []
+	for n in range(head - count, head):
+		out.append(RECORD.unpack_from(data, base + (n % ring) * RECORD.size))
+	return out
+
+def records_from_log(text):
+	out = []
+	for m in re.finditer(r'M7TR ([0-9a-f]{%d})' % (RECORD.size * 2), text):
+		out.append(RECORD.unpack(bytes.fromhex(m.group(1))))
+	return out
+
+def path_names(text):
+	return {int(m.group(1)): m.group(2) for m in re.finditer(r'M7FLY path (\d+) (\S+)', text)}
+
+def frames(records):
+	# race lateness is a running total, hblank lateness is per frame
+	prev_late = None
+	for r in records:
+		frame, stamps, steps, late, ticks, path, hbl_late = r[0], r[1:6], r[6], r[7], r[8], r[9], r[10]
+		lens = [(stamps[i + 1] - stamps[i]) & 0xFFFFFFFF for i in range(len(PHASES))]
+		late_frame = 0 if prev_late is None else (late - prev_late) & 0xFFFF
+		prev_late = late
+		yield frame, lens, steps, late_frame, ticks, path, hbl_late
+
+def load(path):
+	with open(path, 'rb') as f:
+		data = f.read()
+	text = data.decode('latin-1')
+	records = records_from_log(text)
+	if not records:
+		records = records_from_dump(data)
+	return list(frames(records)), path_names(text)
+
+def percentiles(rows):
+	# per path: phases, total, dda steps and late lines per frame
+	out = {}
+	for frame, lens, steps, late, ticks, path, hbl_late in rows:
+		if path:
+			out.setdefault(path, []).append(lens + [sum(lens), steps, late, hbl_late])
+	for path, samples in out.items():
+		cols = []
+		for values in zip(*samples):
+			values = sorted(values)
+			pick = lambda q: values[min(len(values) - 1, len(values) * q // 100)]
+			cols.append((pick(50), pick(90), pick(99), values[-1]))
+		out[path] = (len(samples), cols)
+	return out
+
+mode = '--csv'
+args = sys.argv[1:]
+if args and args[0].startswith('--'):
+	mode = args.pop(0)
+rows, names = load(args[0])
+
+if mode == '--csv':
+	print('frame,' + ','.join(PHASES) + ',total,dda_steps,race_late,ticks,path,hbl_late')
+	for frame, lens, steps, late, ticks, path, hbl_late in rows:
+		print('%d,%s,%d,%d,%d,%d,%d,%d' % (frame, ','.join(str(l) for l in lens), sum(lens), steps, late,
+			ticks, path, hbl_late))
+elif mode == '--folded':
+	totals = [sum(r[1][i] for r in rows) for i in range(len(PHASES))]
+	for name, total in zip(PHASES, totals):
+		print('frame;%s %d' % (name, total))
+elif mode == '--summary':
+	frame_total = sum(sum(r[1]) for r in rows) or 1
+	print('%d frames' % len(rows))
+	print('%-8s %8s %8s %8s %6s' % ('phase', 'min', 'avg', 'max', 'share'))
+	for i, name in enumerate(PHASES):
+		lens = [r[1][i] for r in rows]
+		print('%-8s %8d %8d %8d %5.1f%%' % (name, min(lens), sum(lens) // len(lens), max(lens),
+			100.0 * sum(lens) / frame_total))
+	late = sum(r[3] for r in rows)
+	hbl_late = sum(r[6] for r in rows)
+	steps = sum(r[2] for r in rows)
+	print('late lines %d race, %d hblank, dda steps %d per frame' % (late, hbl_late, steps // len(rows)))
+elif mode == '--percentiles':
+	fields = PHASES + ['total', 'dda_steps', 'race_late', 'hbl_late']
+	ours = percentiles(rows)
+	theirs = percentiles(load(args[1])[0]) if len(args) > 1 else {}
+	assert ours, 'no flythrough frames, build with FLY_ENABLED'
+	for path in sorted(ours):
+		count, cols = ours[path]
+		print('path %d %s, %d frames' % (path, names.get(path, '?'), count))
+		print('%-10s %9s %9s %9s %9s' % ('', 'p50', 'p90', 'p99', 'max'))
+		for i, name in enumerate(fields):
+			line = '%-10s' % name + ''.join(' %9d' % v for v in cols[i])
+			if path in theirs:
+				# change from the first input to the second
+				other = theirs[path][1][i]
+				line += '  |' + ''.join(' %+6.1f%%' % (100.0 * (b - a) / a if a else 0.0)
+					for a, b in zip(cols[i], other))
+			print(line)
+		print()
+else:
+	sys.exit('unknown mode %s' % mode)
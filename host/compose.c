@@ -0,0 +1,292 @@
+#include <stdio.h>
+
+#include <tonc.h>
+
+#include "compose.h"
+#include "shim.h"
+
+#define OBJ_LAYER 4
+#define BD_LAYER 5
+
+/* one layer's pixels for the line being composed. 0 is transparent */
+typedef struct {
+	u16 color[SCREEN_WIDTH];
+	u8 opaque[SCREEN_WIDTH];
+	u8 prio[SCREEN_WIDTH]; /* objects carry their own */
+} line_t;
+
+static line_t layers[5];
+
+static void text_line(int bg, int line, line_t *out) {
+	u16 cnt = REG_BGCNT[bg];
+	int cbb = (cnt >> 2) & 3, sbb = (cnt >> 8) & 31;
+	int width = (cnt & BIT(14)) ? 512 : 256, height = (cnt & BIT(15)) ? 512 : 256;
+	int y = (line + REG_BG_OFS[bg].y) & (height - 1);
+
+	for (int sx = 0; sx < SCREEN_WIDTH; sx++) {
+		int x = (sx + REG_BG_OFS[bg].x) & (width - 1);
+
+		/* 32x32 screenblocks, left to right then down */
+		int block = sbb + (x >> 8) + (y >> 8) * (width >> 8);
+		u16 se = se_mem[block][((y >> 3) & 31) * 32 + ((x >> 3) & 31)];
+		int px = (se & SE_HFLIP) ? 7 - (x & 7) : (x & 7);
+		int py = (se & SE_VFLIP) ? 7 - (y & 7) : (y & 7);
+
+		int index;
+		if (cnt & BG_8BPP) {
+			index = ((u8*)tile8_mem[cbb])[(se & SE_ID_MASK) * 64 + py * 8 + px];
+		} else {
+			u8 pair = ((u8*)tile_mem[cbb])[(se & SE_ID_MASK) * 32 + py * 4 + px / 2];
+			index = (px & 1) ? pair >> 4 : pair & 15;
+			index = index ? index + (se >> 12) * 16 : 0;
+		}
+		out->opaque[sx] = index != 0;
+		out->color[sx] = pal_bg_mem[index];
+	}
+}
+
+static void affine_line(int bg, line_t *out) {
+	u16 cnt = REG_BGCNT[bg];
+	const BG_AFFINE *aff = &REG_BG_AFFINE[bg];
+	const u8 *tiles = (const u8*)tile_mem[(cnt >> 2) & 3];
+	const u8 *map = (const u8*)se_mem[(cnt >> 8) & 31];
+	int size = 128 << (cnt >> 14);
+
+	s32 x = aff->dx, y = aff->dy;
+	for (int sx = 0; sx < SCREEN_WIDTH; sx++, x += aff->pa, y += aff->pc) {
+		int tx = x >> 8, ty = y >> 8;
+		out->opaque[sx] = 0;
+
+		if (cnt & BG_WRAP) {
+			tx &= size - 1;
+			ty &= size - 1;
+		} else if ((tx < 0) || (ty < 0) || (tx >= size) || (ty >= size)) {
+			continue;
+		}
+
+		int tile = map[(ty >> 3) * (size >> 3) + (tx >> 3)];
+		int index = tiles[tile * 64 + (ty & 7) * 8 + (tx & 7)];
+		out->opaque[sx] = index != 0;
+		out->color[sx] = pal_bg_mem[index];
+	}
+}
+
+static void obj_line(int line, line_t *out) {
+	int mapping_1d = REG_DISPCNT & DCNT_OBJ_1D;
+
+	for (int sx = 0; sx < SCREEN_WIDTH; sx++) {
+		out->opaque[sx] = 0;
+	}
+
+	/* lowest id wins, so draw back to front */
+	for (int id = 127; id >= 0; id--) {
+		const OBJ_ATTR *obj = &oam_mem[id];
+		int affine = obj->attr0 & ATTR0_AFF;
+		if (!affine && (obj->attr0 & ATTR0_HIDE)) {
+			continue;
+		}
+
+		const u8 *size = oam_sizes[(obj->attr0 >> 14) & 3][(obj->attr1 >> 14) & 3];
+		int w = size[0], h = size[1];
+		int box_w = w, box_h = h;
+		if (affine && (obj->attr0 & ATTR0_AFF_DBL_BIT)) {
+			box_w *= 2;
+			box_h *= 2;
+		}
+
+		int top = obj->attr0 & 0xFF, left = obj->attr1 & 0x1FF;
+		if (top + box_h > 256) { top -= 256; }
+		if (left >= 256) { left -= 512; }
+		int oy = line - top;
+		if ((oy < 0) || (oy >= box_h)) {
+			continue;
+		}
+
+		int bpp8 = obj->attr0 & ATTR0_8BPP;
+		int tile_id = obj->attr2 & ATTR2_ID_MASK;
+		int prio = (obj->attr2 >> 10) & 3;
+		int bank = obj->attr2 >> 12;
+		int stride = mapping_1d ? (w / 8) << (bpp8 ? 1 : 0) : 32;
+
+		const OBJ_AFFINE *mat = &obj_aff_mem[(obj->attr1 >> 9) & 31];
+		for (int ox = 0; ox < box_w; ox++) {
+			int sx = left + ox;
+			if ((sx < 0) || (sx >= SCREEN_WIDTH)) {
+				continue;
+			}
+
+			/* texel, around the center for affine sprites */
+			int tx = ox, ty = oy;
+			if (affine) {
+				int cx = ox - box_w / 2, cy = oy - box_h / 2;
+				tx = ((mat->pa * cx + mat->pb * cy) >> 8) + w / 2;
+				ty = ((mat->pc * cx + mat->pd * cy) >> 8) + h / 2;
+				if ((tx < 0) || (ty < 0) || (tx >= w) || (ty >= h)) {
+					continue;
+				}
+			} else {
+				if (obj->attr1 & ATTR1_HFLIP) { tx = w - 1 - tx; }
+				if (obj->attr1 & ATTR1_VFLIP) { ty = h - 1 - ty; }
+			}
+
+			int tile = tile_id + (ty >> 3) * stride + ((tx >> 3) << (bpp8 ? 1 : 0));
+			const u8 *texels = (const u8*)tile_mem_obj[0] + (tile & 1023) * 32;
+			int index;
+			if (bpp8) {
+				index = texels[(ty & 7) * 8 + (tx & 7)];
+			} else {
+				u8 pair = texels[(ty & 7) * 4 + (tx & 7) / 2];
+				index = (tx & 1) ? pair >> 4 : pair & 15;
+				index = index ? index + bank * 16 : 0;
+			}
+			if (index) {
+				out->opaque[sx] = 1;
+				out->color[sx] = pal_obj_mem[index];
+				out->prio[sx] = prio;
+			}
+		}
+	}
+}
+
+/* layers each window shows, bit 5 enables blending */
+static int window_mask(int line, int x) {
+	u16 dispcnt = REG_DISPCNT;
+	if (!(dispcnt & (DCNT_WIN0 | DCNT_WIN1))) {
+		return 0x3F;
+	}
+
+	for (int w = 0; w < 2; w++) {
+		if (!(dispcnt & (DCNT_WIN0 << w))) {
+			continue;
+		}
+
+		/* bad ranges run to the edge of the screen */
+		u16 h = w ? REG_WIN1H : REG_WIN0H, v = w ? REG_WIN1V : REG_WIN0V;
+		int x1 = h >> 8, x2 = h & 0xFF, y1 = v >> 8, y2 = v & 0xFF;
+		if ((x2 > SCREEN_WIDTH) || (x1 > x2)) { x2 = SCREEN_WIDTH; }
+		if ((y2 > SCREEN_HEIGHT) || (y1 > y2)) { y2 = SCREEN_HEIGHT; }
+
+		if ((x >= x1) && (x < x2) && (line >= y1) && (line < y2)) {
+			return (REG_WININ >> (w * 8)) & 0x3F;
+		}
+	}
+	return REG_WINOUT & 0x3F;
+}
+
+static u16 fade(u16 c, int y, int up) {
+	int out = 0;
+	for (int shift = 0; shift < 15; shift += 5) {
+		int ch = (c >> shift) & 31;
+		ch = up ? ch + (((31 - ch) * y) >> 4) : ch - ((ch * y) >> 4);
+		out |= ch << shift;
+	}
+	return out;
+}
+
+static u16 alpha(u16 a, u16 b, int eva, int evb) {
+	int out = 0;
+	for (int shift = 0; shift < 15; shift += 5) {
+		int ch = ((((a >> shift) & 31) * eva) + (((b >> shift) & 31) * evb)) >> 4;
+		out |= MIN(ch, 31) << shift;
+	}
+	return out;
+}
+
+void host_compose_line(int line, u16 *dst) {
+	u16 dispcnt = REG_DISPCNT;
+	int mode = dispcnt & 7;
+
+	/* backgrounds the mode has, and which of them are affine */
+	int present = (mode == 0) ? 0xF : (mode == 1) ? 0x7 : (mode == 2) ? 0xC : 0;
+	int affine = (mode == 1) ? 0x4 : (mode == 2) ? 0xC : 0;
+	int shown = present & (dispcnt >> 8);
+
+	for (int bg = 0; bg < 4; bg++) {
+		if (shown & BIT(bg)) {
+			if (affine & BIT(bg)) {
+				affine_line(bg, &layers[bg]);
+			} else {
+				text_line(bg, line, &layers[bg]);
+			}
+		}
+	}
+	if (dispcnt & DCNT_OBJ) {
+		obj_line(line, &layers[OBJ_LAYER]);
+		shown |= BIT(OBJ_LAYER);
+	}
+
+	u16 bldcnt = REG_BLDCNT;
+	int bld_mode = (bldcnt >> 6) & 3;
+	int ey = MIN(REG_BLDY & 31, 16);
+	int eva = MIN(REG_BLDALPHA & 31, 16), evb = MIN((REG_BLDALPHA >> 8) & 31, 16);
+
+	for (int x = 0; x < SCREEN_WIDTH; x++) {
+		int mask = window_mask(line, x) & (shown | BIT(5));
+
+		/* top two layers: lower priority first, objects before
+		   backgrounds, then by background number */
+		int top = BD_LAYER, next = BD_LAYER;
+		int top_key = 0x7FFF, next_key = 0x7FFF;
+		for (int layer = 0; layer < 5; layer++) {
+			if (!(mask & BIT(layer)) || !layers[layer].opaque[x]) {
+				continue;
+			}
+			int prio = (layer == OBJ_LAYER) ? layers[layer].prio[x] : (REG_BGCNT[layer] & 3);
+			int key = prio * 8 + ((layer == OBJ_LAYER) ? 0 : layer + 1);
+			if (key < top_key) {
+				next = top; next_key = top_key;
+				top = layer; top_key = key;
+			} else if (key < next_key) {
+				next = layer; next_key = key;
+			}
+		}
+
+		u16 c = (top == BD_LAYER) ? pal_bg_mem[0] : layers[top].color[x];
+		if ((mask & BIT(5)) && (bldcnt & BIT(top))) {
+			if ((bld_mode == 1) && (bldcnt & BIT(next + 8))) {
+				u16 b = (next == BD_LAYER) ? pal_bg_mem[0] : layers[next].color[x];
+				c = alpha(c, b, eva, evb);
+			} else if (bld_mode >= 2) {
+				c = fade(c, ey, bld_mode == 2);
+			}
+		}
+		dst[x] = c & 0x7FFF;
+	}
+}
+
+void host_compose_frame(void (*hbl)(), u16 *frame) {
+	for (int line = 0; line < SCREEN_HEIGHT; line++) {
+		/* the hblank before a line sets it up */
+		if (hbl) {
+			host_hblank(line == 0 ? 227 : line - 1);
+			hbl();
+		}
+		host_compose_line(line, &frame[line * SCREEN_WIDTH]);
+	}
+}
+
+u32 host_frame_hash(const u16 *frame) {
+	u32 hash = 2166136261u;
+	for (int i = 0; i < HOST_FRAME_SIZE; i++) {
+		hash = (hash ^ (frame[i] & 0xFF)) * 16777619;
+		hash = (hash ^ (frame[i] >> 8)) * 16777619;
+	}
+	return hash;
+}
+
+int host_write_ppm(const char *path, const u16 *frame) {
+	FILE *f = fopen(path, "wb");
+	if (f == NULL) {
+		return 0;
+	}
+
+	fprintf(f, "P6\n%d %d\n255\n", SCREEN_WIDTH, SCREEN_HEIGHT);
+	for (int i = 0; i < HOST_FRAME_SIZE; i++) {
+		for (int shift = 0; shift < 15; shift += 5) {
+			int ch = (frame[i] >> shift) & 31;
+			fputc((ch << 3) | (ch >> 2), f);
+		}
+	}
+	fclose(f);
+	return 1;
+}
@@ -0,0 +1,21 @@
+#ifndef COMPOSE_H_
+#define COMPOSE_H_
+
+#include <tonc.h>
+
+/* headless stand-in for the display. lines are rendered from whatever is
+   in the registers, palette, vram and oam when they are composed, so
+   running the hblank isr before each line plays back its tables.
+   covers modes 0-2: text and affine backgrounds, win0 / win1, alpha and
+   fade blending, and regular and affine sprites. affine reference points
+   are read from BGxX / BGxY every line, as if rewritten in each hblank
+   (m7_hbl always does), instead of stepping them by pb / pd */
+
+#define HOST_FRAME_SIZE (SCREEN_WIDTH * SCREEN_HEIGHT)
+
+void host_compose_line(int line, u16 *dst);
+void host_compose_frame(void (*hbl)(), u16 *frame);
+u32 host_frame_hash(const u16 *frame);
+int host_write_ppm(const char *path, const u16 *frame);
+
+#endif
@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <time.h>
+
+#include <tonc.h>
+
+#include "../mode7.h"
+#include "../objmux.h"
+#include "shim.h"
+
+/* microbenchmark of the mode 7 core on the host. a generated corridor
+   stands in for a level, the camera flies a fixed path through it and
+   a checksum of the tables is printed so runs can be compared */
+
+#define BENCH_CHUNKS 8
+#define BENCH_W (BENCH_CHUNKS * M7_CHUNK_W)
+#define BENCH_H 16
+#define BENCH_FRAMES 2000
+
+/* globals main.c has on the target */
+m7_cam_t m7_cam;
+u16 floor_winh[SCREEN_HEIGHT + 1], wall_winh[SCREEN_HEIGHT + 1];
+BG_AFFINE floor_bgaff_arr[SCREEN_HEIGHT + 1], wall_bgaff_arr[SCREEN_HEIGHT + 1];
+FIXED floor_inv_lambda[SCREEN_HEIGHT + 1], wall_inv_lambda[SCREEN_HEIGHT + 1];
+m7_level_t floor_level, wall_level;
+m7_latch_t m7_latch;
+m7_race_t m7_race;
+VECTOR m7_obj_pos[M7_OBJ_COUNT];
+OBJ_ATTR m7_oam[128];
+m7_obj_meta_t m7_obj_meta[M7_OBJ_COUNT];
+FIXED m7_obj_inv_lambda[M7_OBJ_COUNT];
+
+static u8 floor_chunks[BENCH_W * BENCH_H], wall_chunks[BENCH_W * BENCH_H];
+static u8 floor_blocks_buf[BENCH_H * M7_WINDOW_W], wall_blocks_buf[BENCH_H * M7_WINDOW_W];
+static u16 floor_solid_buf[BENCH_H * M7_WINDOW_CHUNKS], wall_solid_buf[BENCH_H * M7_WINDOW_CHUNKS];
+static m7_extent_t extents[1];
+static u8 extent_ids[BENCH_W * BENCH_H];
+static m7_material_t materials[4];
+
+static void bench_level(m7_level_t *level, u8 *chunks, int wall) {
+	/* floor and ceiling slabs, the wall layer adds pillars. rays only
+	   stop at blocks in y, so the wall layer is closed with end blocks */
+	for (int z = 0; z < BENCH_W; z++) {
+		for (int y = 0; y < BENCH_H; y++) {
+			int code = 0;
+			if ((y < 2) || (y >= BENCH_H - 2)) {
+				code = wall ? M7_BLOCK_END : 2;
+			} else if (wall && ((z % 12) == 6) && (y < 8)) {
+				code = 3;
+			}
+			chunks[(z / M7_CHUNK_W) * BENCH_H * M7_CHUNK_W + y * M7_CHUNK_W + (z % M7_CHUNK_W)] = code;
+		}
+	}
+
+	level->chunks = chunks;
+	level->blocks_width = BENCH_W;
+	level->blocks_height = BENCH_H;
+	level->texture_width = level->texture_height = 512;
+	level->a_x_range = int2fx(level->texture_width / level->blocks_height);
+	level->materials = materials;
+	level->extents = extents;
+	level->extent_ids = extent_ids;
+	level->strip = NULL;
+}
+
+static u32 checksum(u32 sum, const void *data, int size) {
+	const u8 *p = data;
+	for (int i = 0; i < size; i++) {
+		sum = (sum ^ p[i]) * 16777619;
+	}
+	return sum;
+}
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main() {
+	host_init();
+
+	for (int i = 0; i < 4; i++) {
+		for (int side = 0; side < 4; side++) {
+			materials[i].sides[side].x = side * 128;
+			materials[i].sides[side].y = i * 64;
+		}
+	}
+	extents[0].width = int2fx(64);
+	extents[0].off = int2fx(16);
+
+	bench_level(&floor_level, floor_chunks, 0);
+	bench_level(&wall_level, wall_chunks, 1);
+	m7_init(&floor_level, &m7_cam, floor_bgaff_arr, floor_winh, floor_inv_lambda,
+		BG_CBB(0) | BG_SBB(24) | BG_AFF_128x128 | BG_PRIO(2), 2);
+	m7_init(&wall_level, &m7_cam, wall_bgaff_arr, wall_winh, wall_inv_lambda,
+		BG_CBB(0) | BG_SBB(24) | BG_AFF_128x128 | BG_PRIO(1), 3);
+
+	/* same setup as init_map */
+	m7_cam.pos.x = 8 << FIX_SHIFT;
+	m7_cam.pos.y = 4 << FIX_SHIFT;
+	m7_cam.pos.z = (BENCH_W - 4) << FIX_SHIFT;
+	m7_cam.fov = fxdiv(int2fx(M7_TOP), int2fx(M7_D));
+	m7_rotate(&m7_cam, 0);
+	m7_init_window(&floor_level, floor_blocks_buf, floor_solid_buf);
+	m7_init_window(&wall_level, wall_blocks_buf, wall_solid_buf);
+
+	pre.inv_fov = fxdiv(int2fx(1), m7_cam.fov);
+	pre.inv_fov_x_ppb = fxdiv(int2fx(1), m7_cam.fov * PIX_PER_BLOCK);
+	for (int h = 0; h < SCREEN_HEIGHT; h++) {
+		pre.x_cs[h] = fxsub(2 * fxdiv(int2fx(h), int2fx(SCREEN_HEIGHT)), int2fx(1));
+	}
+
+	double t_rotate = 0, t_move = 0, t_prep = 0, t_hbl = 0;
+	u32 sum = 2166136261u;
+
+	for (int f = 0; f < BENCH_FRAMES; f++) {
+		/* forwards until the end, swaying the pitch */
+		VECTOR dir = { (f & 64) ? 0x40 : -0x40, 0, -0x10 };
+		int theta = lu_sin(f * 0x100) >> 2;
+
+		double t0 = now();
+		m7_rotate(&m7_cam, theta);
+		double t1 = now();
+		m7_translate_local(&floor_level, &dir);
+		m7_update_window(&floor_level);
+		m7_update_window(&wall_level);
+		double t2 = now();
+		m7_prep_affines(&wall_level, &floor_level);
+		double t3 = now();
+		for (int vc = 0; vc < SCREEN_HEIGHT; vc++) {
+			host_hblank(vc == 0 ? 227 : vc - 1);
+			m7_hbl();
+		}
+		double t4 = now();
+		mux_vbl();
+
+		t_rotate += t1 - t0;
+		t_move += t2 - t1;
+		t_prep += t3 - t2;
+		t_hbl += t4 - t3;
+
+		sum = checksum(sum, floor_bgaff_arr, sizeof(floor_bgaff_arr));
+		sum = checksum(sum, wall_bgaff_arr, sizeof(wall_bgaff_arr));
+		sum = checksum(sum, floor_winh, sizeof(floor_winh));
+		sum = checksum(sum, wall_winh, sizeof(wall_winh));
+		sum = checksum(sum, &m7_cam.pos, sizeof(m7_cam.pos));
+	}
+
+	printf("%d frames, camera ends at %x %x %x\n", BENCH_FRAMES,
+		m7_cam.pos.x, m7_cam.pos.y, m7_cam.pos.z);
+	printf("m7_rotate          %8.0f ns\n", t_rotate / BENCH_FRAMES * 1e9);
+	printf("m7_translate_local %8.0f ns (with window update)\n", t_move / BENCH_FRAMES * 1e9);
+	printf("m7_prep_affines    %8.0f ns\n", t_prep / BENCH_FRAMES * 1e9);
+	printf("m7_hbl             %8.0f ns per line\n", t_hbl / BENCH_FRAMES / SCREEN_HEIGHT * 1e9);
+	printf("checksum %08x\n", sum);
+
+	return 0;
+}
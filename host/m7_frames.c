@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <tonc.h>
+
+#include "../mode7.h"
+#include "../lzstream.h"
+#include "../objmux.h"
+#include "compose.h"
+#include "shim.h"
+#include "fanroom_level.h"
+
+/* renders the fan room from a fixed set of camera poses through the real
+   m7_hbl tables and prints a hash per frame, so a change to the core can
+   be checked for pixel equivalence by diffing the output of two builds.
+   with an output directory each frame is also written there as a ppm.
+   sprites are not spawned, the frames cover the backgrounds only
+
+   usage: m7_frames [out_dir] */
+
+/* same layout as main.c */
+#define M7_CBB 0
+#define FLOOR_SBB 24
+#define FLOOR_PRIO 2
+#define WALL_PRIO 1
+
+/* globals main.c has on the target */
+m7_cam_t m7_cam;
+u16 floor_winh[SCREEN_HEIGHT + 1], wall_winh[SCREEN_HEIGHT + 1];
+BG_AFFINE floor_bgaff_arr[SCREEN_HEIGHT + 1], wall_bgaff_arr[SCREEN_HEIGHT + 1];
+FIXED floor_inv_lambda[SCREEN_HEIGHT + 1], wall_inv_lambda[SCREEN_HEIGHT + 1];
+m7_level_t floor_level, wall_level;
+m7_latch_t m7_latch;
+m7_race_t m7_race;
+VECTOR m7_obj_pos[M7_OBJ_COUNT];
+OBJ_ATTR m7_oam[128];
+m7_obj_meta_t m7_obj_meta[M7_OBJ_COUNT];
+FIXED m7_obj_inv_lambda[M7_OBJ_COUNT];
+
+static u8 floor_blocks_buf[M7_MAX_HEIGHT * M7_WINDOW_W], wall_blocks_buf[M7_MAX_HEIGHT * M7_WINDOW_W];
+static u16 floor_solid_buf[M7_MAX_HEIGHT * M7_WINDOW_CHUNKS], wall_solid_buf[M7_MAX_HEIGHT * M7_WINDOW_CHUNKS];
+static u8 floor_obj_cells[M7_MAX_WIDTH * M7_MAX_HEIGHT];
+
+typedef struct {
+	int x, y, z; /* blocks, .8f */
+	int theta;
+} pose_t;
+
+/* start, pitched both ways, along the room and against the walls */
+static const pose_t poses[] = {
+	{ 8 << 8, 2 << 8, 2 << 8, 0x0000 },
+	{ 8 << 8, 2 << 8, 2 << 8, 0x1000 },
+	{ 8 << 8, 2 << 8, 2 << 8, 0xF000 },
+	{ 4 << 8, 3 << 8, 10 << 8, 0x2000 },
+	{ 12 << 8, 6 << 8, 16 << 8, 0xE800 },
+	{ 8 << 8, 0x180, 24 << 8, 0x0800 },
+	{ 1 << 8, 2 << 8, 28 << 8, 0x0000 },
+	{ 15 << 8, 8 << 8, 30 << 8, 0x3000 },
+};
+
+#define POSE_COUNT (sizeof(poses) / sizeof(poses[0]))
+
+static u16 frame[HOST_FRAME_SIZE];
+
+static void init_map() {
+	const m7_level_hdr_t *hdr = &fanroom_level;
+
+	if (!m7_load_level(&floor_level, &wall_level, hdr)) {
+		fprintf(stderr, "level: bad magic or version, or too large\n");
+		exit(1);
+	}
+	floor_level.obj_cells = floor_obj_cells;
+
+	m7_init(&floor_level, &m7_cam, floor_bgaff_arr, floor_winh, floor_inv_lambda,
+		BG_CBB(M7_CBB) | BG_SBB(FLOOR_SBB) | BG_AFF_128x128 | BG_PRIO(FLOOR_PRIO), 2);
+	m7_init(&wall_level, &m7_cam, wall_bgaff_arr, wall_winh, wall_inv_lambda,
+		BG_CBB(M7_CBB) | BG_SBB(FLOOR_SBB) | BG_AFF_128x128 | BG_PRIO(WALL_PRIO), 3);
+	m7_cam.fov = fxdiv(int2fx(M7_TOP), int2fx(M7_D));
+
+	pre.inv_fov = fxdiv(int2fx(1), m7_cam.fov);
+	pre.inv_fov_x_ppb = fxdiv(int2fx(1), m7_cam.fov * PIX_PER_BLOCK);
+	for (int h = 0; h < SCREEN_HEIGHT; h++) {
+		pre.x_cs[h] = fxsub(2 * fxdiv(int2fx(h), int2fx(SCREEN_HEIGHT)), int2fx(1));
+	}
+
+	/* textures in one go, load_step streams them on the target */
+	hlz_decomp(M7_LEVEL_PTR(hdr, pal), pal_bg_mem);
+	hlz_decomp(M7_LEVEL_PTR(hdr, tiles), tile_mem[M7_CBB]);
+	hlz_decomp(M7_LEVEL_PTR(hdr, map), floor_level.map);
+
+	REG_BLDCNT = BLD_BUILD(BLD_BG2 | BLD_BG3, BLD_BACKDROP, 3);
+	REG_WININ = WININ_BUILD(WIN_BG2 | WIN_BG3 | WIN_BLD, 0);
+	REG_WIN0V = SCREEN_HEIGHT;
+	REG_DISPCNT = DCNT_MODE2 | DCNT_OBJ | DCNT_OBJ_1D | DCNT_WIN0 | DCNT_BG2 | DCNT_BG3;
+
+	obj_hide_multi(oam_mem, 128);
+}
+
+int main(int argc, char **argv) {
+	host_init();
+	init_map();
+
+	for (int i = 0; i < POSE_COUNT; i++) {
+		m7_cam.pos.x = poses[i].x;
+		m7_cam.pos.y = poses[i].y;
+		m7_cam.pos.z = poses[i].z;
+		m7_rotate(&m7_cam, poses[i].theta);
+
+		/* fresh window, the poses are far apart */
+		m7_init_window(&floor_level, floor_blocks_buf, floor_solid_buf);
+		m7_init_window(&wall_level, wall_blocks_buf, wall_solid_buf);
+
+		m7_prep_affines(&wall_level, &floor_level);
+		host_compose_frame(m7_hbl, frame);
+		mux_vbl();
+
+		printf("pose %d %08x\n", i, host_frame_hash(frame));
+		if (argc > 1) {
+			char path[256];
+			snprintf(path, sizeof(path), "%s/pose%02d.ppm", argv[1], i);
+			if (!host_write_ppm(path, frame)) {
+				fprintf(stderr, "can't write %s\n", path);
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,417 @@
+#include <stdio.h>
+
+#include <tonc.h>
+
+#include "../mode7.h"
+#include "../collide.h"
+#include "../objmux.h"
+#include "shim.h"
+
+/* unit tests for the mode 7 core on the host. a small generated room: a
+   floor and ceiling two blocks thick and a wall across the room at
+   TEST_WALL_Z, all in the floor layer. the wall layer is empty */
+
+#define TEST_W (2 * M7_CHUNK_W)
+#define TEST_H 16
+#define TEST_WALL_Z 10
+#define TEST_WALL_CODE 2
+
+/* globals main.c has on the target */
+m7_cam_t m7_cam;
+u16 floor_winh[SCREEN_HEIGHT + 1], wall_winh[SCREEN_HEIGHT + 1];
+BG_AFFINE floor_bgaff_arr[SCREEN_HEIGHT + 1], wall_bgaff_arr[SCREEN_HEIGHT + 1];
+FIXED floor_inv_lambda[SCREEN_HEIGHT + 1], wall_inv_lambda[SCREEN_HEIGHT + 1];
+m7_level_t floor_level, wall_level;
+m7_latch_t m7_latch;
+m7_race_t m7_race;
+VECTOR m7_obj_pos[M7_OBJ_COUNT];
+OBJ_ATTR m7_oam[128];
+m7_obj_meta_t m7_obj_meta[M7_OBJ_COUNT];
+FIXED m7_obj_inv_lambda[M7_OBJ_COUNT];
+
+static u8 floor_chunks[TEST_W * TEST_H], wall_chunks[TEST_W * TEST_H];
+static u8 floor_blocks_buf[TEST_H * M7_WINDOW_W], wall_blocks_buf[TEST_H * M7_WINDOW_W];
+static u16 floor_solid_buf[TEST_H * M7_WINDOW_CHUNKS], wall_solid_buf[TEST_H * M7_WINDOW_CHUNKS];
+static m7_extent_t extents[1];
+static u8 extent_ids[TEST_W * TEST_H];
+static m7_material_t materials[4];
+
+/* a streamed level, longer than the ring of map rows */
+#define STRIP_W (8 * M7_CHUNK_W)
+#define STRIP_ROWS (STRIP_W * PIX_PER_BLOCK / 8)
+#define STRIP_COLS (512 / 8)
+
+static m7_level_t strip_level;
+static u8 strip_chunks[STRIP_W * TEST_H];
+static u8 strip_blocks_buf[TEST_H * M7_WINDOW_W];
+static u16 strip_solid_buf[TEST_H * M7_WINDOW_CHUNKS];
+static BG_AFFINE strip_bgaff[SCREEN_HEIGHT + 1];
+static u16 strip_winh[SCREEN_HEIGHT + 1];
+static FIXED strip_inv_lambda[SCREEN_HEIGHT + 1];
+static u8 strip[STRIP_ROWS * STRIP_COLS * 2];
+
+static int failures;
+
+#define CHECK_EQ(a, b) check_eq(__FILE__, __LINE__, #a, (a), (b))
+
+static void check_eq(const char *file, int line, const char *expr, long a, long b) {
+	if (a != b) {
+		printf("%s:%d: %s is %ld (0x%lx), expected %ld (0x%lx)\n", file, line, expr, a, a, b, b);
+		failures++;
+	}
+}
+
+static void test_level(m7_level_t *level, u8 *chunks, int wall) {
+	for (int z = 0; z < TEST_W; z++) {
+		for (int y = 0; y < TEST_H; y++) {
+			int code = 0;
+			if ((y < 2) || (y >= TEST_H - 2)) {
+				code = wall ? M7_BLOCK_END : TEST_WALL_CODE;
+			} else if (!wall && (z == TEST_WALL_Z)) {
+				code = TEST_WALL_CODE;
+			}
+			chunks[(z / M7_CHUNK_W) * TEST_H * M7_CHUNK_W + y * M7_CHUNK_W + (z % M7_CHUNK_W)] = code;
+		}
+	}
+
+	level->chunks = chunks;
+	level->blocks_width = TEST_W;
+	level->blocks_height = TEST_H;
+	level->texture_width = level->texture_height = 512;
+	level->a_x_range = int2fx(level->texture_width / level->blocks_height);
+	level->materials = materials;
+	level->extents = extents;
+	level->extent_ids = extent_ids;
+	level->strip = NULL;
+}
+
+static void place(int x, int y, int z, int theta) {
+	m7_cam.pos.x = x;
+	m7_cam.pos.y = y;
+	m7_cam.pos.z = z;
+	m7_rotate(&m7_cam, theta);
+	m7_init_window(&floor_level, floor_blocks_buf, floor_solid_buf);
+	m7_init_window(&wall_level, wall_blocks_buf, wall_solid_buf);
+}
+
+static void test_load_level() {
+	m7_level_hdr_t hdr = { 0 };
+	m7_level_t floor, wall;
+
+	hdr.magic = M7_LEVEL_MAGIC;
+	hdr.version = M7_LEVEL_VERSION;
+	hdr.blocks_width = M7_MAX_WIDTH;
+	hdr.blocks_height = M7_MAX_HEIGHT;
+	hdr.texture_width = hdr.texture_height = 512;
+	CHECK_EQ(m7_load_level(&floor, &wall, &hdr), 1);
+
+	/* the per cell buffers would overflow */
+	hdr.blocks_width = M7_MAX_WIDTH + M7_CHUNK_W;
+	CHECK_EQ(m7_load_level(&floor, &wall, &hdr), 0);
+	hdr.blocks_width = M7_MAX_WIDTH;
+	hdr.blocks_height = M7_MAX_HEIGHT + 1;
+	CHECK_EQ(m7_load_level(&floor, &wall, &hdr), 0);
+
+	hdr.blocks_height = M7_MAX_HEIGHT;
+	hdr.version = M7_LEVEL_VERSION - 1;
+	CHECK_EQ(m7_load_level(&floor, &wall, &hdr), 0);
+}
+
+static void test_rotate() {
+	m7_cam_t cam = {0};
+
+	m7_rotate(&cam, 0);
+	CHECK_EQ(cam.u.x, 0x100);
+	CHECK_EQ(cam.v.y, 0x100);
+	CHECK_EQ(cam.v.z, 0);
+	CHECK_EQ(cam.w.y, 0);
+	CHECK_EQ(cam.w.z, 0x100);
+
+	/* a quarter turn, v and w rotate in the y / z plane */
+	m7_rotate(&cam, 0x4000);
+	CHECK_EQ(cam.v.y, 0);
+	CHECK_EQ(cam.v.z, -0x100);
+	CHECK_EQ(cam.w.y, 0x100);
+	CHECK_EQ(cam.w.z, 0);
+
+	m7_rotate(&cam, 0x8000);
+	CHECK_EQ(cam.v.y, -0x100);
+	CHECK_EQ(cam.w.z, -0x100);
+
+	/* 4096 sin 45 is 2896, truncated to .8f */
+	m7_rotate(&cam, 0x2000);
+	CHECK_EQ(cam.v.y, 181);
+	CHECK_EQ(cam.v.z, -181);
+	CHECK_EQ(cam.w.y, 181);
+	CHECK_EQ(cam.w.z, 181);
+
+	/* angles wrap */
+	m7_rotate(&cam, 0x14000);
+	CHECK_EQ(cam.theta, 0x4000);
+	CHECK_EQ(cam.w.y, 0x100);
+}
+
+static void test_translate() {
+	/* forwards into the wall stops flush, radius short of it */
+	place(int2fx(8), int2fx(4), int2fx(8), 0);
+	VECTOR fwd = { 0, 0, int2fx(3) };
+	m7_translate_local(&floor_level, &fwd);
+	CHECK_EQ(m7_cam.pos.z, int2fx(TEST_WALL_Z) - M7_CAM_RADIUS);
+	CHECK_EQ(m7_cam.pos.y, int2fx(4));
+
+	/* and stays there */
+	m7_translate_local(&floor_level, &fwd);
+	CHECK_EQ(m7_cam.pos.z, int2fx(TEST_WALL_Z) - M7_CAM_RADIUS);
+
+	/* diagonally into it slides along it */
+	place(int2fx(8), int2fx(4), int2fx(8), 0);
+	VECTOR diag = { 0, int2fx(2), int2fx(3) };
+	m7_translate_local(&floor_level, &diag);
+	CHECK_EQ(m7_cam.pos.z, int2fx(TEST_WALL_Z) - M7_CAM_RADIUS);
+	CHECK_EQ(m7_cam.pos.y, int2fx(6));
+
+	/* up to the ceiling, pitched a quarter turn so forwards is +y */
+	place(int2fx(8), int2fx(4), int2fx(5), 0x4000);
+	m7_translate_local(&floor_level, &fwd);
+	CHECK_EQ(m7_cam.pos.y, int2fx(7));
+	m7_translate_local(&floor_level, &fwd);
+	m7_translate_local(&floor_level, &fwd);
+	m7_translate_local(&floor_level, &fwd);
+	CHECK_EQ(m7_cam.pos.y, int2fx(TEST_H - 2) - M7_CAM_RADIUS);
+	CHECK_EQ(m7_cam.pos.z, int2fx(5));
+
+	/* strafing stops at the texture's x range instead, 512 / 16 blocks */
+	place(int2fx(31), int2fx(4), int2fx(5), 0);
+	VECTOR strafe = { int2fx(2), 0, 0 };
+	m7_translate_local(&floor_level, &strafe);
+	CHECK_EQ(m7_cam.pos.x, int2fx(31));
+	strafe.x = int2fx(1);
+	m7_translate_local(&floor_level, &strafe);
+	CHECK_EQ(m7_cam.pos.x, int2fx(32));
+
+	/* col_sweep reports the blocked axes */
+	VECTOR pos = { 0, int2fx(4), int2fx(8) };
+	VECTOR d = { 0, int2fx(1), int2fx(3) };
+	CHECK_EQ(col_sweep(&floor_level, &pos, &d, M7_CAM_RADIUS), COL_HIT_Z);
+	d.y = -int2fx(3); d.z = 0;
+	CHECK_EQ(col_sweep(&floor_level, &pos, &d, M7_CAM_RADIUS), COL_HIT_Y);
+	CHECK_EQ(pos.y, int2fx(2) + M7_CAM_RADIUS);
+}
+
+static void test_prep_affines() {
+	/* eight blocks from the wall, level. the middle row's ray runs
+	   straight down z to it, where a fov of 1/2 makes lambda exactly 1 */
+	place(int2fx(8), int2fx(4) + 0x80, int2fx(2), 0);
+	m7_prep_affines(&wall_level, &floor_level);
+
+	const int h = SCREEN_HEIGHT / 2;
+	const POINT16 *east = &materials[TEST_WALL_CODE].sides[2];
+
+	CHECK_EQ(floor_level.bgaff[h].pa, 0x100);
+	CHECK_EQ(floor_level.inv_lambda[h], 0x100);
+	CHECK_EQ(floor_level.bgaff[h].dx, M7_LEFT * 0x100 + 8 * PIX_PER_BLOCK * 0x100 + int2fx(east->x));
+	/* 8 blocks along a ray 1/256 up, plus the camera height */
+	CHECK_EQ(floor_level.bgaff[h].dy, (8 + 0x480) * PIX_PER_BLOCK + int2fx(east->y));
+	/* shading reads lambda from bg3 */
+	CHECK_EQ(floor_level.bgaff[h].pb, 0x100);
+
+	/* the extent is centered, 32 pixels either side of the middle */
+	CHECK_EQ(floor_level.winh[h], WIN_BUILD(M7_RIGHT + 32, M7_RIGHT + 1 - 32));
+
+	/* nothing in the wall layer but the end blocks */
+	CHECK_EQ(wall_level.bgaff[h].pa, 0);
+	CHECK_EQ(wall_level.inv_lambda[h], 0);
+
+	/* the line past the screen repeats the first */
+	CHECK_EQ(floor_level.bgaff[SCREEN_HEIGHT].dx, floor_level.bgaff[0].dx);
+}
+
+static void test_hbl_latched_rows() {
+	/* tilted, so every row has its own affine */
+	place(int2fx(8), int2fx(4), int2fx(2), 0x0800);
+	m7_prep_affines(&wall_level, &floor_level);
+	CHECK_EQ(floor_level.bgaff[SCREEN_HEIGHT - 1].dx != floor_level.bgaff[0].dx, 1);
+
+	/* pitched down: the bottom lines repeat the last row, not the first */
+	m7_latch.rows = M7_LATCH_MAX_ROWS;
+	for (int vc = SCREEN_HEIGHT - M7_LATCH_MAX_ROWS - 1; vc < SCREEN_HEIGHT - 1; vc++) {
+		host_hblank(vc);
+		m7_hbl();
+		CHECK_EQ(REG_BG2X, floor_level.bgaff[SCREEN_HEIGHT - 1].dx);
+		CHECK_EQ(REG_BG2PA, floor_level.bgaff[SCREEN_HEIGHT - 1].pa);
+	}
+
+	/* and pitched up the first lines repeat the first row */
+	m7_latch.rows = -M7_LATCH_MAX_ROWS;
+	host_hblank(227);
+	m7_hbl();
+	CHECK_EQ(REG_BG2X, floor_level.bgaff[0].dx);
+
+	/* the line after the screen still sets up for the next frame */
+	host_hblank(SCREEN_HEIGHT - 1);
+	m7_hbl();
+	CHECK_EQ(REG_BG2X, floor_level.bgaff[0].dx);
+	m7_latch.rows = 0;
+}
+
+static void test_sweep_outside_window() {
+	/* a long level with a wall far past the camera's window */
+	m7_level_t far_level = floor_level;
+	static u8 far_chunks[STRIP_W * TEST_H];
+	static u8 far_blocks_buf[TEST_H * M7_WINDOW_W];
+	static u16 far_solid_buf[TEST_H * M7_WINDOW_CHUNKS];
+	const int wall_z = STRIP_W - 20;
+
+	for (int y = 0; y < TEST_H; y++) {
+		far_chunks[((wall_z / M7_CHUNK_W) * TEST_H + y) * M7_CHUNK_W + (wall_z % M7_CHUNK_W)] = TEST_WALL_CODE;
+	}
+	far_level.chunks = far_chunks;
+	far_level.blocks_width = STRIP_W;
+
+	m7_cam.pos.z = int2fx(8);
+	m7_init_window(&far_level, far_blocks_buf, far_solid_buf);
+	CHECK_EQ(wall_z >= far_level.window_z + M7_WINDOW_W, 1);
+
+	/* moves freely out there, and stops flush at the wall */
+	VECTOR pos = { 0, int2fx(4), int2fx(wall_z - 6) };
+	VECTOR d = { 0, 0, int2fx(2) };
+	CHECK_EQ(col_sweep(&far_level, &pos, &d, M7_CAM_RADIUS), 0);
+	CHECK_EQ(pos.z, int2fx(wall_z - 4));
+	d.z = int2fx(4);
+	CHECK_EQ(col_sweep(&far_level, &pos, &d, M7_CAM_RADIUS), COL_HIT_Z);
+	CHECK_EQ(pos.z, int2fx(wall_z) - M7_CAM_RADIUS);
+
+	/* past the end of the level is solid */
+	pos.z = int2fx(STRIP_W - 1);
+	CHECK_EQ(col_sweep(&far_level, &pos, &d, M7_CAM_RADIUS), COL_HIT_Z);
+	CHECK_EQ(pos.z, int2fx(STRIP_W) - M7_CAM_RADIUS);
+}
+
+static void test_latch_objects() {
+	/* two texture pixels per screen pixel */
+	m7_obj_inv_lambda[0] = int2fx(1) / 2;
+	obj_set_pos(&m7_oam[0], 10, 20);
+	obj_set_pos(&m7_oam[1], 2, 20);
+	m7_obj_inv_lambda[1] = int2fx(1);
+	m7_commit_objects();
+
+	/* a strafe right slides objects left, by less further away */
+	m7_latch.dx = int2fx(8);
+	m7_latch_objects();
+	CHECK_EQ(BFN_GET(oam_mem[0].attr1, ATTR1_X), 6);
+	CHECK_EQ(BFN_GET(oam_mem[0].attr0, ATTR0_Y), 20);
+	CHECK_EQ(BFN_GET(oam_mem[1].attr1, ATTR1_X), (2 - 8) & ATTR1_X_MASK);
+
+	/* pitched down, the floor moves up and so does everything on it */
+	m7_latch.rows = 3;
+	m7_latch_objects();
+	CHECK_EQ(BFN_GET(oam_mem[0].attr0, ATTR0_Y), 17);
+	CHECK_EQ(BFN_GET(oam_mem[0].attr1, ATTR1_X), 6);
+
+	/* latched again without a commit in between, the old shifts go */
+	m7_latch.dx = 0;
+	m7_latch.rows = -2;
+	m7_latch_objects();
+	CHECK_EQ(BFN_GET(oam_mem[0].attr1, ATTR1_X), 10);
+	CHECK_EQ(BFN_GET(oam_mem[1].attr1, ATTR1_X), 2);
+	CHECK_EQ(BFN_GET(oam_mem[0].attr0, ATTR0_Y), 22);
+
+	/* multiplexed sprites get the same shifts */
+	CHECK_EQ(BFN_GET(mux_latch_attr0(ATTR0_Y(255)), ATTR0_Y), 1);
+	m7_latch.dx = int2fx(8);
+	CHECK_EQ(BFN_GET(mux_latch_attr1(ATTR1_X(10), int2fx(1) / 2), ATTR1_X), 6);
+	m7_latch.dx = 0;
+	m7_latch.rows = 0;
+}
+
+/* every map row of the chunks in the window, floor and ceiling columns */
+static void check_ring(const m7_level_t *level) {
+	int rows = M7_CHUNK_W * PIX_PER_BLOCK / 8;
+	int bad = 0;
+
+	for (int slot = 0; slot < M7_WINDOW_CHUNKS; slot++) {
+		int chunk = level->window_chunks[slot];
+		for (int r = chunk * rows; (r >= 0) && (r < STRIP_ROWS) && (r < (chunk + 1) * rows); r++) {
+			const u8 *dst = &level->map[(r & (M7_RING_ROWS - 1)) * M7_MAP_W];
+			const u8 *src = &strip[r * STRIP_COLS * 2];
+			for (int c = 0; c < STRIP_COLS; c++) {
+				bad += (dst[c] != src[c]);
+				bad += (dst[level->texture_height / 8 + c] != src[STRIP_COLS + c]);
+			}
+		}
+	}
+	CHECK_EQ(bad, 0);
+	CHECK_EQ(level->ring_pending, 0);
+}
+
+static void test_stream_map() {
+	for (int i = 0; i < sizeof(strip); i++) {
+		strip[i] = (i * 7 + (i >> 8)) & 0xFF;
+	}
+
+	strip_level = floor_level;
+	strip_level.chunks = strip_chunks;
+	strip_level.blocks_width = STRIP_W;
+	strip_level.strip = strip;
+	strip_level.strip_rows = STRIP_ROWS;
+	m7_init(&strip_level, &m7_cam, strip_bgaff, strip_winh, strip_inv_lambda,
+		BG_CBB(0) | BG_SBB(16) | BG_AFF_128x128 | BG_WRAP | BG_PRIO(2), 2);
+
+	/* the start, then far enough along that the ring has wrapped */
+	m7_cam.pos.z = int2fx(8);
+	m7_init_window(&strip_level, strip_blocks_buf, strip_solid_buf);
+	CHECK_EQ(strip_level.ring_pending, 0xF);
+	m7_stream_map(&strip_level);
+	check_ring(&strip_level);
+
+	for (int z = 8; z < STRIP_W - 8; z += 4) {
+		m7_cam.pos.z = int2fx(z);
+		m7_update_window(&strip_level);
+		m7_stream_map(&strip_level);
+	}
+	CHECK_EQ(strip_level.window_chunks[0] * M7_CHUNK_W * PIX_PER_BLOCK / 8 >= M7_RING_ROWS, 1);
+	check_ring(&strip_level);
+}
+
+int main() {
+	host_init();
+
+	for (int i = 0; i < 4; i++) {
+		for (int side = 0; side < 4; side++) {
+			materials[i].sides[side].x = side * 128;
+			materials[i].sides[side].y = i * 64;
+		}
+	}
+	extents[0].width = int2fx(32);
+	extents[0].off = int2fx(8);
+
+	test_level(&floor_level, floor_chunks, 0);
+	test_level(&wall_level, wall_chunks, 1);
+	m7_init(&floor_level, &m7_cam, floor_bgaff_arr, floor_winh, floor_inv_lambda,
+		BG_CBB(0) | BG_SBB(24) | BG_AFF_128x128 | BG_PRIO(2), 2);
+	m7_init(&wall_level, &m7_cam, wall_bgaff_arr, wall_winh, wall_inv_lambda,
+		BG_CBB(0) | BG_SBB(24) | BG_AFF_128x128 | BG_PRIO(1), 3);
+
+	m7_cam.fov = fxdiv(int2fx(M7_TOP), int2fx(M7_D));
+	pre.inv_fov = fxdiv(int2fx(1), m7_cam.fov);
+	pre.inv_fov_x_ppb = fxdiv(int2fx(1), m7_cam.fov * PIX_PER_BLOCK);
+	for (int h = 0; h < SCREEN_HEIGHT; h++) {
+		pre.x_cs[h] = fxsub(2 * fxdiv(int2fx(h), int2fx(SCREEN_HEIGHT)), int2fx(1));
+	}
+
+	test_load_level();
+	test_rotate();
+	test_translate();
+	test_prep_affines();
+	test_hbl_latched_rows();
+	test_sweep_outside_window();
+	test_latch_objects();
+	test_stream_map();
+
+	if (failures) {
+		printf("%d failed\n", failures);
+		return 1;
+	}
+	printf("all passed\n");
+	return 0;
+}
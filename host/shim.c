@@ -0,0 +1,118 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include <tonc.h>
+
+#include "shim.h"
+
+/* libtonc data, same values */
+s16 sin_lut[514];
+const BG_AFFINE bg_aff_default = { 256, 0, 0, 256, 0, 0 };
+const u8 oam_sizes[3][4][2] = {
+	{ { 8, 8}, {16,16}, {32,32}, {64,64} },
+	{ {16, 8}, {32, 8}, {32,16}, {64,32} },
+	{ { 8,16}, { 8,32}, {16,32}, {32,64} },
+};
+
+static const struct { uintptr_t addr, size; } host_regions[] = {
+	{ MEM_EWRAM, EWRAM_SIZE },
+	{ MEM_IWRAM, IWRAM_SIZE },
+	{ MEM_IO, 0x400 },
+	{ MEM_PAL, PAL_SIZE },
+	{ MEM_VRAM, VRAM_SIZE },
+	{ MEM_OAM, OAM_SIZE },
+};
+
+void host_init() {
+	for (int i = 0; i < sizeof(host_regions) / sizeof(host_regions[0]); i++) {
+		void *p = mmap((void*)host_regions[i].addr, host_regions[i].size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+		if (p != (void*)host_regions[i].addr) {
+			fprintf(stderr, "can't map %#lx\n", (unsigned long)host_regions[i].addr);
+			exit(1);
+		}
+	}
+
+	/* libtonc's table is .12f truncated towards zero */
+	for (int i = 0; i < 514; i++) {
+		sin_lut[i] = (s16)(4096.0 * sin(i * M_PI / 256.0));
+	}
+}
+
+/* bios ArcTan / ArcTan2, after the algorithm in gbatek */
+static s32 host_arctan(s32 i) {
+	s32 a = -((i * i) >> 14);
+	s32 b = ((0xA9 * a) >> 14) + 0x390;
+	b = ((b * a) >> 14) + 0x91C;
+	b = ((b * a) >> 14) + 0xFB6;
+	b = ((b * a) >> 14) + 0x16AA;
+	b = ((b * a) >> 14) + 0x2081;
+	b = ((b * a) >> 14) + 0x3651;
+	b = ((b * a) >> 14) + 0xA2F9;
+	return (i * b) >> 16;
+}
+
+s16 ArcTan2(s16 x, s16 y) {
+	if (y == 0) {
+		return (x >= 0) ? 0 : 0x8000;
+	}
+	if (x == 0) {
+		return (y >= 0) ? 0x4000 : 0xC000;
+	}
+	if (y >= 0) {
+		if (x >= 0) {
+			if (x >= y) {
+				return host_arctan((y << 14) / x);
+			}
+		} else if (-x >= y) {
+			return host_arctan((y << 14) / x) + 0x8000;
+		}
+		return 0x4000 - host_arctan((x << 14) / y);
+	}
+	if (x <= 0) {
+		if (-x > -y) {
+			return host_arctan((y << 14) / x) + 0x8000;
+		}
+	} else if (x >= -y) {
+		return host_arctan((y << 14) / x) + 0x10000;
+	}
+	return 0xC000 - host_arctan((x << 14) / y);
+}
+
+/* libtonc copies and fills */
+void *tonccpy(void *dst, const void *src, uint size) {
+	for (uint i = 0; i < size; i++) {
+		((u8*)dst)[i] = ((const u8*)src)[i];
+	}
+	return dst;
+}
+
+void *__toncset(void *dst, u32 fill, uint size) {
+	for (uint i = 0; i < size; i++) {
+		((u8*)dst)[i] = fill >> (8 * (((uintptr_t)dst + i) & 3));
+	}
+	return dst;
+}
+
+void memcpy32(void *dst, const void *src, uint wcount) {
+	for (uint i = 0; i < wcount; i++) {
+		((u32*)dst)[i] = ((const u32*)src)[i];
+	}
+}
+
+void obj_copy(OBJ_ATTR *dst, const OBJ_ATTR *src, uint count) {
+	for (uint i = 0; i < count; i++) {
+		dst[i].attr0 = src[i].attr0;
+		dst[i].attr1 = src[i].attr1;
+		dst[i].attr2 = src[i].attr2;
+	}
+}
+
+void obj_hide_multi(OBJ_ATTR *obj, u32 count) {
+	for (u32 i = 0; i < count; i++) {
+		obj_hide(&obj[i]);
+	}
+}
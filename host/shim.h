@@ -0,0 +1,21 @@
+#ifndef SHIM_H_
+#define SHIM_H_
+
+/* newlib's, named by the tte console hooks in tonc_tte.h */
+struct _reent;
+
+#include <tonc.h>
+
+/* runs the mode 7 core natively. the real tonc headers are used as they
+   are: host_init maps memory at the gba addresses so registers, vram and
+   oam are plain memory, and shim.c stands in for the libtonc functions
+   and bios calls the core links against */
+void host_init();
+
+/* what the display would do before m7_hbl runs for line vc */
+INLINE void host_hblank(int vc) {
+	REG_VCOUNT = vc;
+	REG_DISPSTAT |= DSTAT_IN_HBL;
+}
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef LZSTREAM_H_
+#define LZSTREAM_H_
+
+#include <tonc.h>
+
+#define LZ_TYPE_LZ77 0x10 /* bios lz77 */
+#define LZ_TYPE_HLZ 0x40 /* halfword lz, see gfx/hlz.py */
+
+/* resumable decoder for bios lz77 and hlz data. output is written in
+   halfwords, so the destination can be vram */
+typedef struct {
+	const u8 *src;
+	u16 *dst;
+	u32 size, pos; /* output bytes */
+	u32 flags; /* lz77 block flags, msb first */
+	u16 flag_bits;
+	u16 pending; /* lz77 low byte waiting for its partner */
+	u16 copy_len, copy_disp; /* back reference cut off by the budget */
+	const u16 *lit; /* hlz literal stream */
+	u16 lit_len;
+	u8 type, token;
+	u8 match_next; /* hlz match still to read after the literals */
+} lz_stream_t;
+
+void lz_init(lz_stream_t *s, const void *src, void *dst);
+IWRAM_CODE int lz_step(lz_stream_t *s, int budget);
+
+/* whole hlz block at once, a halfword is written past odd sizes */
+IWRAM_CODE void hlz_decomp(const void *src, void *dst);
+
+#endif
@@ -0,0 +1,198 @@
+#include <tonc.h>
+
+#include "lzstream.h"
+
+void lz_init(lz_stream_t *s, const void *src, void *dst) {
+	u32 header = *(const u32*)src;
+
+	s->src = (const u8*)src + 4;
+	s->dst = dst;
+	s->type = header & 0xFF;
+	s->size = header >> 8;
+	s->pos = 0;
+	s->flags = 0;
+	s->flag_bits = 0;
+	s->pending = 0;
+	s->copy_len = 0;
+	s->copy_disp = 0;
+
+	if (s->type == LZ_TYPE_HLZ) {
+		s->src = (const u8*)src + 8;
+		s->lit = (const u16*)((const u8*)src + ((const u32*)src)[1]);
+	}
+	s->lit_len = 0;
+	s->token = 0;
+	s->match_next = 0;
+}
+
+IWRAM_CODE static inline u32
+read_out(const lz_stream_t *s, u32 ofs) {
+	/* byte not written to the destination yet */
+	if (ofs == s->pos - 1 && (s->pos & 1)) {
+		return s->pending;
+	}
+
+	u32 hw = s->dst[ofs >> 1];
+	return (ofs & 1) ? (hw >> 8) : (hw & 0xFF);
+}
+
+IWRAM_CODE static inline void
+write_out(lz_stream_t *s, u32 b) {
+	if (s->pos & 1) {
+		s->dst[s->pos >> 1] = s->pending | (b << 8);
+	} else {
+		s->pending = b;
+
+		/* odd sized data, the last byte has no partner */
+		if (s->pos + 1 == s->size) {
+			s->dst[s->pos >> 1] = b;
+		}
+	}
+	s->pos++;
+}
+
+IWRAM_CODE static int
+lz77_step(lz_stream_t *s, int budget) {
+	while ((budget > 0) && (s->pos < s->size)) {
+		/* finish a back reference first */
+		if (s->copy_len > 0) {
+			write_out(s, read_out(s, s->pos - s->copy_disp));
+			s->copy_len--;
+			budget--;
+			continue;
+		}
+
+		if (s->flag_bits == 0) {
+			s->flags = *s->src++;
+			s->flag_bits = 8;
+		}
+
+		if (s->flags & 0x80) {
+			u32 b0 = *s->src++;
+			u32 b1 = *s->src++;
+			s->copy_len = (b0 >> 4) + 3;
+			s->copy_disp = (((b0 & 0xF) << 8) | b1) + 1;
+		} else {
+			write_out(s, *s->src++);
+			budget--;
+		}
+
+		s->flags <<= 1;
+		s->flag_bits--;
+	}
+
+	return s->size - s->pos;
+}
+
+IWRAM_CODE static inline void
+copy16(u16 *dst, const u16 *src, u32 n) {
+	/* words when both sides line up, also safe for matches 2+ back */
+	if ((((u32)dst ^ (u32)src) & 2) == 0) {
+		if (((u32)dst & 2) && (n > 0)) {
+			*dst++ = *src++;
+			n--;
+		}
+
+		u32 *dst32 = (u32*)dst;
+		const u32 *src32 = (const u32*)src;
+		for (; n >= 2; n -= 2) {
+			*dst32++ = *src32++;
+		}
+		dst = (u16*)dst32;
+		src = (const u16*)src32;
+	}
+
+	while (n--) {
+		*dst++ = *src++;
+	}
+}
+
+IWRAM_CODE static inline u32
+hlz_length(const u8 **src, u32 len) {
+	/* lz4 style, 255 means keep adding */
+	if (len == 15) {
+		u32 b;
+		do {
+			b = *(*src)++;
+			len += b;
+		} while (b == 255);
+	}
+	return len;
+}
+
+IWRAM_CODE static int
+hlz_step(lz_stream_t *s, int budget) {
+	u32 end = (s->size + 1) & ~1;
+
+	while ((budget > 0) && (s->pos < end)) {
+		u16 *out = &s->dst[s->pos >> 1];
+		u32 n;
+
+		if (s->lit_len > 0) {
+			n = MIN(s->lit_len, (u32)(budget + 1) >> 1);
+			copy16(out, s->lit, n);
+			s->lit += n;
+			s->lit_len -= n;
+		} else if (s->match_next) {
+			/* literals done, now the match */
+			u32 ofs = s->src[0] | (s->src[1] << 8);
+			s->src += 2;
+			s->copy_len = hlz_length(&s->src, s->token & 0xF) + 2;
+			s->copy_disp = ofs;
+			s->match_next = 0;
+			continue;
+		} else if (s->copy_len > 0) {
+			n = MIN(s->copy_len, (u32)(budget + 1) >> 1);
+			copy16(out, out - s->copy_disp, n);
+			s->copy_len -= n;
+		} else {
+			/* next sequence */
+			s->token = *s->src++;
+			s->lit_len = hlz_length(&s->src, s->token >> 4);
+			s->match_next = 1;
+			continue;
+		}
+
+		s->pos += n * 2;
+		budget -= n * 2;
+	}
+
+	return (s->pos >= s->size) ? 0 : s->size - s->pos;
+}
+
+/* decodes up to budget output bytes, returns the bytes still to go */
+IWRAM_CODE int
+lz_step(lz_stream_t *s, int budget) {
+	if (s->type == LZ_TYPE_HLZ) {
+		return hlz_step(s, budget);
+	}
+	return lz77_step(s, budget);
+}
+
+IWRAM_CODE void
+hlz_decomp(const void *src, void *dst) {
+	const u32 *header = src;
+	const u8 *ctl = (const u8*)src + 8;
+	const u16 *lit = (const u16*)((const u8*)src + header[1]);
+	u16 *out = dst;
+	u16 *end = out + (((header[0] >> 8) + 1) >> 1);
+
+	while (1) {
+		u32 token = *ctl++;
+		u32 n = hlz_length(&ctl, token >> 4);
+
+		copy16(out, lit, n);
+		out += n;
+		lit += n;
+		if (out >= end) {
+			break;
+		}
+
+		u32 ofs = ctl[0] | (ctl[1] << 8);
+		ctl += 2;
+		n = hlz_length(&ctl, token & 0xF) + 2;
+
+		copy16(out, out - ofs, n);
+		out += n;
+	}
+}
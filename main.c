@@ -4,11 +4,20 @@
 #include <tonc.h>
 
 #include "mode7.h"
-
-#include "gfx/fanroom.h"
-#include "gfx/bgpal.h"
+#include "fly.h"
+#include "lzstream.h"
+#include "objmux.h"
+#include "profile.h"
+#include "tilecache.h"
+#include "trace.h"
+
+#include "gfx/fanroom_level.h"
+#include "gfx/karts.h"
+#include "gfx/thwomp.h"
+#include "gfx/objpal.h"
 
 // #define TTE_ENABLED
+// #define RACE_THE_BEAM
 
 #define DEBUG(fmt, ...)
 #define DEBUGFMT(fmt, ...)
@@ -27,9 +36,22 @@ char *dbg_str;
 /* block mappings */
 #define M7_CBB 0
 #define FLOOR_SBB 24
+#define RING_SBB 16 /* streamed levels, floor map then wall map */
 #define FLOOR_PRIO 2
 #define WALL_PRIO 1
 
+#define THWOMP_TILE (1024 - TC_STATIC_BLOCKS * TC_BLOCK_TILES)
+#define THWOMP_ROWS 8
+#define THWOMP_COLS 16
+
+#define LOAD_BYTES 4096 /* texture bytes decompressed per frame */
+
+#define SIM_TICK 256 /* one frame, time is kept in 1/256 frames */
+#define SIM_MAX_TICKS 4 /* catch up at most this far, then drop time */
+#define LATCH_LINE 225 /* late input read, just before the frame is scanned out */
+#define LATCH_PITCH_SHIFT 2 /* latch this fraction of a tick's turn, the tick does the rest */
+#define RACE_BATCH 8 /* rows built between checks of the beam */
+
 #define TTE_CBB 2
 #define TTE_SBB 18
 
@@ -38,9 +60,31 @@ m7_cam_t m7_cam;
 
 u16 floor_winh[SCREEN_HEIGHT + 1], wall_winh[SCREEN_HEIGHT + 1];
 BG_AFFINE floor_bgaff_arr[SCREEN_HEIGHT+1], wall_bgaff_arr[SCREEN_HEIGHT+1];
+FIXED floor_inv_lambda[SCREEN_HEIGHT + 1], wall_inv_lambda[SCREEN_HEIGHT + 1];
+m7_latch_t m7_latch;
+m7_race_t m7_race;
 m7_level_t floor_level, wall_level;
+EWRAM_DATA u8 floor_obj_cells[M7_MAX_WIDTH * M7_MAX_HEIGHT];
+IWRAM_DATA u8 floor_blocks_buf[M7_MAX_HEIGHT * M7_WINDOW_W], wall_blocks_buf[M7_MAX_HEIGHT * M7_WINDOW_W];
+IWRAM_DATA u16 floor_solid_buf[M7_MAX_HEIGHT * M7_WINDOW_CHUNKS], wall_solid_buf[M7_MAX_HEIGHT * M7_WINDOW_CHUNKS];
+
+/* simulation clock */
+volatile u32 vbl_count;
+u32 sim_time;
+m7_cam_t cam_prev; /* camera before the last tick, rendering lerps from it */
+
+/* level textures, streamed in over several frames */
+lz_stream_t load_streams[3];
+int load_stream_count, load_stream_cur;
+
+/* sprite sheets referenced by level spawns */
+TILE *const level_sheets[] = { (TILE*)kartsTiles };
 
-m7_obj_t m7_obj_arr[M7_OBJ_COUNT];
+IWRAM_DATA VECTOR m7_obj_pos[M7_OBJ_COUNT];
+OBJ_ATTR m7_oam[128];
+m7_obj_meta_t m7_obj_meta[M7_OBJ_COUNT];
+FIXED m7_obj_inv_lambda[M7_OBJ_COUNT];
+m7_bb_t thwomps[THWOMP_ROWS * THWOMP_COLS];
 
 static const m7_cam_t m7_cam_default = {
 	{ 8 << FIX_SHIFT, 2 << FIX_SHIFT, 2 << FIX_SHIFT }, /* pos */
@@ -54,95 +98,50 @@ static const m7_cam_t m7_cam_default = {
 /* prototypes */
 
 void init_main();
+void fatal(const char *msg);
+
+void load_begin(const m7_level_hdr_t *hdr);
+int load_step(int budget);
 
 void input_game();
 void camera_update();
+void camera_interpolate(m7_cam_t *cam, const m7_cam_t *prev, const m7_cam_t *cur, int alpha);
 
-/* implementations */
-
-const int fanroom_floor_blocks[16 * 32] = {
-  2,2,2,2,2,2,2,2, 2,2,2,2,2,2,2,2, 2,2,2,2,2,2,2,2, 2,2,2,2,2,2,2,2,
-  2,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,2,
-  2,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,2,
-  2,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,2,
-  2,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,2,
-  2,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,2,
-  2,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,2,
-  2,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,2,
-  2,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,3, 3,3,3,3,3,3,3,2,
-  2,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,3,0, 0,0,0,0,0,0,0,2,
-  2,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,3,0,0, 0,0,0,0,0,0,0,2,
-  2,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,3,0,0,0, 0,0,0,0,0,0,0,2,
-  2,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,3,0,0,0,0, 0,0,0,0,0,0,0,2,
-  2,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,3,0,0,0,0,0, 0,0,0,0,0,0,0,2,
-  2,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,3,0,0,0,0,0,0, 0,0,0,0,0,0,0,2,
-  2,2,2,2,2,2,2,2, 2,2,2,2,2,2,2,2, 2,2,2,2,2,2,2,2, 2,2,2,2,2,2,2,2
-};
+void vbl_isr();
+void late_latch();
+void race_prep();
+u32 frame_time();
+void sim_tick();
 
-const int floor_extents[16 * 2] = {
-	0,16, 0,16, 0,16, 0,16, 0,16, 0,16, 0,16, 0,16,
-	0,16, 0,16, 0,16, 0,16, 0,16, 0,16, 0,16, 0,16,
-};
-FIXED floor_extent_widths[16];
-FIXED floor_extent_offs[16];
-
-const int fanroom_wall_blocks[16 * 32] = {
-  1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,
-  1,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 3,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,1,
-  1,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 3,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,1,
-  1,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,1,
-  1,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,1,
-  1,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,1,
-  1,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,1,
-  1,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,1,
-  1,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 3,3,3,3,3,3,3,3, 3,3,3,3,3,3,3,1,
-  1,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 3,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,1,
-  1,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 3,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,1,
-  1,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 3,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,1,
-  1,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 3,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,1,
-  1,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 3,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,1,
-  1,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 3,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,1,
-  1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1
-};
-
-const int wall_extents[16 * 2] = {
-	0,16, 8,16, 8,16, 8,16, 0,16, 0,16, 0,16, 0,16,
-	8,16, 8,16, 8,16, 8,16, 8,16, 8,16, 8,16, 8,16
-};
-FIXED wall_extent_widths[16];
-FIXED wall_extent_offs[16];
+/* implementations */
 
 void init_map() {
-	/* layout level */
-	floor_level.blocks = (int*)fanroom_floor_blocks;
-	wall_level.blocks = (int*)fanroom_wall_blocks;
+	const m7_level_hdr_t *hdr = &fanroom_level;
 
-	floor_level.blocks_width = 32; floor_level.blocks_height = 16;
-	wall_level.blocks_width = 32; wall_level.blocks_height = 16;
-
-	floor_level.texture_width = 256; floor_level.texture_height = 512;
-	wall_level.texture_width = 256; wall_level.texture_height = 512;
-
-	floor_level.a_x_range = int2fx(floor_level.texture_width / floor_level.blocks_height);
-	wall_level.a_x_range = floor_level.a_x_range;
+	/* layout level, nothing below can run on a container it rejects */
+	if (!m7_load_level(&floor_level, &wall_level, hdr)) {
+		fatal("level: bad magic or version, or too large");
+	}
+	floor_level.obj_cells = floor_obj_cells;
 
-	floor_level.extent_widths = floor_extent_widths;
-	floor_level.extent_offs = floor_extent_offs;
-	wall_level.extent_widths = wall_extent_widths;
-	wall_level.extent_offs = wall_extent_offs;
+	/* streamed levels need a map per layer, the rest share one */
+	int floor_sbb = FLOOR_SBB, wall_sbb = FLOOR_SBB;
+	if (floor_level.strip) {
+		floor_sbb = RING_SBB;
+		wall_sbb = RING_SBB + 8;
+	}
 
 	/* init mode 7 */
-	m7_init(&floor_level, &m7_cam, floor_bgaff_arr, floor_winh,
-		BG_CBB(M7_CBB) | BG_SBB(FLOOR_SBB) | BG_AFF_128x128 | BG_PRIO(FLOOR_PRIO), 2);
-	m7_init(&wall_level, &m7_cam, wall_bgaff_arr, wall_winh,
-		BG_CBB(M7_CBB) | BG_SBB(FLOOR_SBB) | BG_AFF_128x128 | BG_PRIO(WALL_PRIO), 3);
+	m7_init(&floor_level, &m7_cam, floor_bgaff_arr, floor_winh, floor_inv_lambda,
+		BG_CBB(M7_CBB) | BG_SBB(floor_sbb) | BG_AFF_128x128 | BG_PRIO(FLOOR_PRIO), 2);
+	m7_init(&wall_level, &m7_cam, wall_bgaff_arr, wall_winh, wall_inv_lambda,
+		BG_CBB(M7_CBB) | BG_SBB(wall_sbb) | BG_AFF_128x128 | BG_PRIO(WALL_PRIO), 3);
 	m7_cam = m7_cam_default;
 	m7_cam.fov = fxdiv(int2fx(M7_TOP), int2fx(M7_D));
 
-	/* extract main bg */
-	LZ77UnCompVram(bgPal, pal_bg_mem);
-	LZ77UnCompVram(fanroomTiles, tile_mem[M7_CBB]);
-	LZ77UnCompVram(fanroomMap, se_mem[FLOOR_SBB]);
+	/* chunks around the starting position */
+	m7_init_window(&floor_level, floor_blocks_buf, floor_solid_buf);
+	m7_init_window(&wall_level, wall_blocks_buf, wall_solid_buf);
 
 	/* precompute for mode 7 */
 	pre.inv_fov = fxdiv(int2fx(1), m7_cam.fov);
@@ -151,34 +150,85 @@ void init_map() {
 		pre.x_cs[h] = fxsub(2 * fxdiv(int2fx(h), int2fx(SCREEN_HEIGHT)), int2fx(1));
 	}
 
-	/* precompute window extent widths */
-	for (int i = 0; i < 16; i++) {
-		floor_extent_widths[i] = fxmul(
-			int2fx(
-				(floor_extents[i * 2 + 1] - floor_extents[i * 2 + 0])
-				* PIX_PER_BLOCK), // normal extent width
-			m7_cam.fov); // adjust for fov
-		floor_extent_offs[i] = (floor_level.a_x_range + int2fx(floor_extents[i * 2])) / 2;
-
-		wall_extent_widths[i] = fxmul(
-			int2fx(
-				(wall_extents[i * 2 + 1] - wall_extents[i * 2 + 0])
-				* PIX_PER_BLOCK), // normal extent width
-			m7_cam.fov); // adjust for fov
-		wall_extent_offs[i] = (wall_level.a_x_range + int2fx(wall_extents[i * 2])) / 2;
-	}
-
 	/* setup shadow fade */
 	REG_BLDCNT = BLD_BUILD(BLD_BG2 | BLD_BG3, BLD_BACKDROP, 3);
 	REG_WININ = WININ_BUILD(WIN_BG2 | WIN_BG3 | WIN_BLD, 0);
 	REG_WIN0V = SCREEN_HEIGHT;
-	pal_bg_mem[0] = CLR_GRAY / 2;
 
-	/* registers */
-	REG_DISPCNT = DCNT_MODE2 | DCNT_BG2 | DCNT_BG3 | DCNT_OBJ | DCNT_OBJ_1D | DCNT_WIN0;
+	/* registers, the level bgs come on once loaded */
+	REG_DISPCNT = DCNT_MODE2 | DCNT_OBJ | DCNT_OBJ_1D | DCNT_WIN0 | DCNT_OAM_HBL;
 #ifdef TTE_ENABLED
 	REG_DISPCNT |= DCNT_BG0;
 #endif
+
+	/* extract main bg */
+	load_begin(hdr);
+}
+
+void fatal(const char *msg) {
+	/* red screen, the reason goes to the debug log */
+	nocash_puts(msg);
+	REG_DISPCNT = DCNT_MODE0;
+	pal_bg_mem[0] = CLR_RED;
+	while (1);
+}
+
+void load_begin(const m7_level_hdr_t *hdr) {
+	/* keep the half-written textures off screen */
+	REG_DISPCNT &= ~(DCNT_BG2 | DCNT_BG3);
+
+	lz_init(&load_streams[0], M7_LEVEL_PTR(hdr, pal), pal_bg_mem);
+	lz_init(&load_streams[1], M7_LEVEL_PTR(hdr, tiles), tile_mem[M7_CBB]);
+	lz_init(&load_streams[2], M7_LEVEL_PTR(hdr, map), floor_level.map);
+	load_stream_count = 3;
+	load_stream_cur = 0;
+}
+
+/* returns progress in .8f, 1 << 8 when done */
+int load_step(int budget) {
+	u32 done = 0, total = 0;
+
+	while ((load_stream_cur < load_stream_count) && (budget > 0)) {
+		lz_stream_t *s = &load_streams[load_stream_cur];
+		int pos = s->pos;
+
+		if (lz_step(s, budget) == 0) {
+			load_stream_cur++;
+
+			/* all in, show the level */
+			if (load_stream_cur == load_stream_count) {
+				pal_bg_mem[0] = CLR_GRAY / 2;
+				REG_DISPCNT |= DCNT_BG2 | DCNT_BG3;
+			}
+		}
+		budget -= s->pos - pos;
+	}
+
+	for (int i = 0; i < load_stream_count; i++) {
+		done += load_streams[i].pos;
+		total += load_streams[i].size;
+	}
+	return (total == 0) ? int2fx(1) : (done << 8) / total;
+}
+
+void init_objects() {
+	LZ77UnCompVram(objPal, pal_obj_mem);
+
+	/* initial placements from the level */
+	m7_init_objects(&floor_level);
+	m7_spawn_level_objects(&floor_level, &fanroom_level, level_sheets);
+
+	/* crowd of thwomps, multiplexed past the oam limit */
+	LZ77UnCompVram(thwompTiles, &tile_mem_obj[0][THWOMP_TILE]);
+	for (int i = 0; i < THWOMP_ROWS * THWOMP_COLS; i++) {
+		m7_bb_t *bb = &thwomps[i];
+
+		bb->pos.x = int2fx(1 + 2 * (i % THWOMP_ROWS));
+		bb->pos.y = int2fx(2);
+		bb->pos.z = int2fx(9 + i / THWOMP_ROWS);
+		bb->anchor.x = 16; bb->anchor.y = 16;
+		obj_set_attr(&bb->obj, ATTR0_SQUARE | ATTR0_4BPP, ATTR1_SIZE_32, ATTR2_ID(THWOMP_TILE));
+	}
 }
 
 const FIXED OMEGA =  0x400;
@@ -210,8 +260,108 @@ void camera_update(VECTOR *dir) {
 	}
 }
 
+void camera_interpolate(m7_cam_t *cam, const m7_cam_t *prev, const m7_cam_t *cur, int alpha) {
+	*cam = *cur;
+
+	cam->pos.x = prev->pos.x + (((cur->pos.x - prev->pos.x) * alpha) >> 8);
+	cam->pos.y = prev->pos.y + (((cur->pos.y - prev->pos.y) * alpha) >> 8);
+	cam->pos.z = prev->pos.z + (((cur->pos.z - prev->pos.z) * alpha) >> 8);
+
+	/* shortest way round */
+	m7_rotate(cam, prev->theta + ((((s16)(cur->theta - prev->theta)) * alpha) >> 8));
+}
+
+void vbl_isr() {
+	PROF_BEGIN(isr_start);
+	vbl_count++;
+
+#ifdef M7_HBL_MONITOR
+	m7_hbl_monitor_vbl();
+#endif
+	PROF_END(PROF_ISR, isr_start);
+}
+
+void late_latch() {
+	PROF_BEGIN(isr_start);
+
+	/* raw keys, key_poll would eat the game's key hits */
+	u32 keys = ~REG_KEYINPUT & KEY_MASK;
+
+	/* one tick ahead of what the tables were built for. a row offset is
+	   only right for small turns, so pitch gets a few rows of it */
+	m7_set_latch(&floor_level, VEL_X * bit_tribool(keys, KI_R, KI_L),
+		-(OMEGA >> LATCH_PITCH_SHIFT) * bit_tribool(keys, KI_RIGHT, KI_LEFT));
+
+	/* still in vblank, sprites follow the latch */
+	m7_latch_objects();
+	mux_latch();
+
+	PROF_END(PROF_ISR, isr_start);
+}
+
+u32 frame_time() {
+	u32 count, vc;
+
+	/* whole frames from vblanks, the rest from the scanline */
+	do {
+		count = vbl_count;
+		vc = REG_VCOUNT;
+	} while (count != vbl_count);
+
+	/* frames start at vblank */
+	vc = (vc >= SCREEN_HEIGHT) ? vc - SCREEN_HEIGHT : vc + 228 - SCREEN_HEIGHT;
+	return (count << 8) + (vc << 8) / 228;
+}
+
+void race_prep() {
+	/* rows only free up once this frame is on screen */
+	while (REG_VCOUNT >= SCREEN_HEIGHT) {
+		Halt();
+	}
+	m7_prep_begin(&wall_level, &floor_level);
+
+	/* build the rows the beam has shown, waking on every hblank. stop
+	   short of vblank, the rest is built ahead of the beam after it */
+	while (m7_race.row < SCREEN_HEIGHT) {
+		int vc = REG_VCOUNT;
+		if (vc >= SCREEN_HEIGHT - 2) {
+			break;
+		}
+
+		int free = vc - M7_RACE_MARGIN;
+		if (free > m7_race.row) {
+			m7_prep_lines(MIN(free, m7_race.row + RACE_BATCH));
+		} else {
+			Halt();
+		}
+	}
+}
+
+void sim_tick() {
+	VECTOR dir = {0, 0, 0};
+
+	cam_prev = m7_cam;
+
+	PROF_BEGIN(input_start);
+#ifdef FLY_ENABLED
+	fly_tick(&m7_cam);
+#else
+	input_game(&dir);
+#endif
+	PROF_END(PROF_INPUT, input_start);
+
+	PROF_BEGIN(cam_start);
+	camera_update(&dir);
+	PROF_END(PROF_CAMERA, cam_start);
+
+#ifdef FLY_RECORD
+	fly_record(&m7_cam);
+#endif
+}
+
 int main() {
 	init_map();
+	init_objects();
 
 	/* hud */
 #ifdef TTE_ENABLED
@@ -223,27 +373,141 @@ int main() {
 	/* irqs */
 	irq_init(NULL);
 	irq_add(II_HBLANK, (fnptr)m7_hbl);
-	irq_add(II_VBLANK, NULL);
+	irq_add(II_VBLANK, vbl_isr);
+	irq_add(II_VCOUNT, late_latch);
+	REG_DISPSTAT = (REG_DISPSTAT & ~DSTAT_VCT_MASK) | DSTAT_VCT(LATCH_LINE);
+#ifdef M7_HBL_MONITOR
+	m7_hbl_monitor_init();
+#endif
+#ifdef PROF_ENABLED
+	prof_init();
+#endif
+#ifdef TRACE_ENABLED
+	tr_init();
+#endif
+
+	cam_prev = m7_cam;
+	sim_time = frame_time();
+	m7_cam_t sim_cam = m7_cam;
+	m7_prep_affines(&wall_level, &floor_level);
 
 	while(1) {
 		VBlankIntrWait();
 
-		/* update camera based on input */
-		VECTOR dir = {0, 0, 0};
-		input_game(&dir);
-		camera_update(&dir);
+#ifdef PROF_ENABLED
+		/* close the frame that just went out */
+		prof_frame();
+#endif
+#ifdef TRACE_ENABLED
+		tr_commit();
+		tr_flush();
+		tr_begin(vbl_count);
+#endif
+
+		/* oam is only safe to touch now */
+		m7_commit_objects();
+		mux_vbl();
+
+		/* stream sprite frames requested last frame */
+		tc_flush(TC_VBL_TILES);
+
+		/* bounded slice of any level load in progress */
+		int load_progress = load_step(LOAD_BYTES);
+
+#ifdef FLY_ENABLED
+		/* paths are timed on the loaded level */
+		if (load_progress == int2fx(1)) {
+			fly_start();
+		}
+#endif
+
+#ifdef RACE_THE_BEAM
+		/* rows left over from last frame, ahead of the beam now */
+		m7_prep_lines(SCREEN_HEIGHT);
+		m7_cam = sim_cam;
+#endif
 
+		/* as many fixed ticks as frames went by, so slow frames drop
+		   instead of slowing the game down */
+		TR_MARK(TR_SIM);
+		int behind = frame_time() - sim_time;
+#ifdef FLY_ENABLED
+		/* a tick a frame however long frames take, so every build
+		   draws the same poses */
+		sim_time = frame_time() - SIM_TICK;
+		behind = SIM_TICK;
+#endif
+		if (behind > SIM_MAX_TICKS * SIM_TICK) {
+			sim_time += behind - SIM_MAX_TICKS * SIM_TICK;
+			behind = SIM_MAX_TICKS * SIM_TICK;
+		}
+		for (; behind >= SIM_TICK; behind -= SIM_TICK) {
+			sim_tick();
+			sim_time += SIM_TICK;
+			TR_ADD(ticks, 1);
+		}
+
+		/* render between the last two ticks */
+		sim_cam = m7_cam;
+		camera_interpolate(&m7_cam, &cam_prev, &sim_cam, CLAMP(behind, 0, SIM_TICK));
+
+		/* bring in chunks the camera moved towards */
+		TR_MARK(TR_PREP);
+		m7_update_window(&floor_level);
+		m7_update_window(&wall_level);
+
+		/* and their map rows once the base map is down. the tables below
+		   reach the screen before the next vblank, so this can't wait */
+		if (load_progress == int2fx(1)) {
+			m7_stream_map(&floor_level);
+			m7_stream_map(&wall_level);
+		}
+
+#ifndef RACE_THE_BEAM
 		/* update affine matrices */
 		m7_prep_affines(&wall_level, &floor_level);
+#endif
 
 		/* update objects */
+		TR_MARK(TR_OBJECTS);
+		PROF_BEGIN(obj_start);
 		m7_update_objects(&floor_level);
+		m7_update_billboards(&floor_level, thwomps, THWOMP_ROWS * THWOMP_COLS);
+		PROF_END(PROF_OBJECTS, obj_start);
+
+#ifndef RACE_THE_BEAM
+		/* back to the simulated camera */
+		m7_cam = sim_cam;
+#endif
 
 		/* update hud */
 #ifdef TTE_ENABLED
-		tte_printf("#{es;P}x %x fov %x",
-			m7_cam.pos.x, m7_cam.fov);
+		tte_printf("#{es;P}x %x fov %x\nobj %d oam- %d hbl- %d\nload %d%% late %d",
+			m7_cam.pos.x, m7_cam.fov,
+			mux_report.count, mux_report.drop_oam, mux_report.drop_hbl,
+			(load_progress * 100) >> 8, m7_race.late);
+#ifdef M7_HBL_MONITOR
+		tte_printf("\nhbl %d-%d late %d",
+			m7_hbl_report.min, m7_hbl_report.max, m7_hbl_report.late);
+#endif
+#ifdef PROF_ENABLED
+		prof_draw();
+#endif
+#else
+		(void)load_progress;
+#endif
+
+#ifdef RACE_THE_BEAM
+		/* tables for the next frame, behind the beam. the camera stays
+		   interpolated until they are done */
+		race_prep();
+#endif
+
+		TR_SET(race_late, m7_race.late);
+#ifdef M7_HBL_MONITOR
+		TR_SET(hbl_late, MIN(m7_hbl_report.late, 255));
 #endif
+		TR_MARK(TR_END);
 	}
 
 	return 0;
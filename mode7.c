@@ -1,13 +1,20 @@
 #include <limits.h>
 #include <tonc.h>
 
+#include "collide.h"
 #include "mode7.h"
+#include "objmux.h"
+#include "tilecache.h"
 
-void m7_init(m7_level_t *level, m7_cam_t *cam, BG_AFFINE bgaff[], u16 *winh_arr, u16 bgcnt, int bgno) {
+m7_hbl_report_t m7_hbl_report, m7_hbl_frame;
+
+void m7_init(m7_level_t *level, m7_cam_t *cam, BG_AFFINE bgaff[], u16 *winh_arr, FIXED *inv_lambda_arr, u16 bgcnt, int bgno) {
 	level->camera = cam;
 	level->bgaff = bgaff;
 	level->winh = winh_arr;
+	level->inv_lambda = inv_lambda_arr;
 	level->bgcnt = bgcnt;
+	level->map = (u8*)se_mem[(bgcnt & BG_SBB_MASK) >> BG_SBB_SHIFT];
 
 	if (bgno == 2) {
 		REG_BG2CNT = bgcnt;
@@ -17,6 +24,110 @@ void m7_init(m7_level_t *level, m7_cam_t *cam, BG_AFFINE bgaff[], u16 *winh_arr,
 	REG_BG_AFFINE[bgno] = bg_aff_default;
 }
 
+int m7_load_level(m7_level_t *floor, m7_level_t *wall, const m7_level_hdr_t *hdr) {
+	if ((hdr->magic != M7_LEVEL_MAGIC) || (hdr->version != M7_LEVEL_VERSION)) {
+		return 0;
+	}
+
+	/* buffers per level cell are sized for the largest level */
+	if ((hdr->blocks_width > M7_MAX_WIDTH) || (hdr->blocks_height > M7_MAX_HEIGHT)) {
+		return 0;
+	}
+
+	/* everything points straight into the container */
+	floor->chunks = M7_LEVEL_PTR(hdr, floor_blocks);
+	wall->chunks = M7_LEVEL_PTR(hdr, wall_blocks);
+
+	floor->blocks_width = wall->blocks_width = hdr->blocks_width;
+	floor->blocks_height = wall->blocks_height = hdr->blocks_height;
+
+	floor->texture_width = wall->texture_width = hdr->texture_width;
+	floor->texture_height = wall->texture_height = hdr->texture_height;
+
+	floor->a_x_range = int2fx(floor->texture_width / floor->blocks_height);
+	wall->a_x_range = floor->a_x_range;
+
+	/* texture origins, layer offsets included */
+	floor->materials = M7_LEVEL_PTR(hdr, floor_materials);
+	wall->materials = M7_LEVEL_PTR(hdr, wall_materials);
+
+	/* map rows for long levels */
+	floor->strip = hdr->floor_strip ? M7_LEVEL_PTR(hdr, floor_strip) : NULL;
+	wall->strip = hdr->wall_strip ? M7_LEVEL_PTR(hdr, wall_strip) : NULL;
+	floor->strip_rows = wall->strip_rows = hdr->strip_rows;
+
+	/* extents were scaled for fov when the level was compiled */
+	floor->extents = M7_LEVEL_PTR(hdr, floor_extents);
+	floor->extent_ids = M7_LEVEL_PTR(hdr, floor_extent_ids);
+	wall->extents = M7_LEVEL_PTR(hdr, wall_extents);
+	wall->extent_ids = M7_LEVEL_PTR(hdr, wall_extent_ids);
+
+	return 1;
+}
+
+void m7_init_window(m7_level_t *level, u8 *blocks_buf, u16 *solid_buf) {
+	/* raycast reads blocks every step, keep the window somewhere fast */
+	level->blocks = blocks_buf;
+	level->solid = solid_buf;
+	level->ring_pending = 0;
+	for (int i = 0; i < M7_WINDOW_CHUNKS; i++) {
+		level->window_chunks[i] = M7_CHUNK_NONE;
+	}
+	m7_update_window(level);
+}
+
+static void load_chunk(m7_level_t *level, int chunk, int slot) {
+	int chunk_count = level->blocks_width / M7_CHUNK_W;
+	u8 *dst = &level->blocks[slot * M7_CHUNK_W];
+	const u8 *src = &level->chunks[chunk * level->blocks_height * M7_CHUNK_W];
+
+	for (int y = 0; y < level->blocks_height; y++) {
+		if ((chunk >= 0) && (chunk < chunk_count)) {
+			tonccpy(dst, src, M7_CHUNK_W);
+		} else {
+			toncset(dst, M7_BLOCK_END, M7_CHUNK_W);
+		}
+		dst += M7_WINDOW_W;
+		src += M7_CHUNK_W;
+	}
+	level->window_chunks[slot] = chunk;
+	level->ring_pending |= BIT(slot);
+	col_fill_chunk(level, slot);
+}
+
+void m7_update_window(m7_level_t *level) {
+	/* chunks whose centers are nearest the camera */
+	int first = (fx2int(level->camera->pos.z) + M7_CHUNK_W / 2) / M7_CHUNK_W - M7_WINDOW_CHUNKS / 2;
+
+	/* only chunks that scrolled in get copied */
+	for (int chunk = first; chunk < first + M7_WINDOW_CHUNKS; chunk++) {
+		int slot = chunk & (M7_WINDOW_CHUNKS - 1);
+		if (level->window_chunks[slot] != chunk) {
+			load_chunk(level, chunk, slot);
+		}
+	}
+	level->window_z = first * M7_CHUNK_W;
+}
+
+void m7_spawn_level_objects(m7_level_t *level, const m7_level_hdr_t *hdr, TILE *const sheets[]) {
+	const m7_spawn_t *spawns = M7_LEVEL_PTR(hdr, spawns);
+
+	for (int i = 0; i < hdr->spawn_count; i++) {
+		const m7_spawn_t *spawn = &spawns[i];
+		TILE *tiles = sheets[spawn->sheet] + spawn->first * M7_OBJ_FRAME_TILES;
+
+		int id = m7_object_id(m7_spawn_object(tiles, spawn->frame_count));
+		if (id < 0) {
+			return;
+		}
+
+		m7_move_object(level, id, &spawn->pos);
+		m7_obj_meta[id].anchor.x = spawn->anchor_x;
+		m7_obj_meta[id].anchor.y = spawn->anchor_y;
+		m7_obj_meta[id].phi = spawn->phi;
+	}
+}
+
 void m7_rotate(m7_cam_t *cam, int theta) {
 	/* limited to fixpoint range */
 	theta &= 0xFFFF;
@@ -45,27 +156,18 @@ void m7_rotate(m7_cam_t *cam, int theta) {
 void m7_translate_local(m7_level_t *level, const VECTOR *dir) {
 	m7_cam_t *cam = level->camera;
 
-	VECTOR pos = cam->pos;
-	pos.x += (cam->u.x * dir->x + cam->v.x * dir->y + cam->w.x * dir->z) >> 8;
-	pos.y += ( 0                + cam->v.y * dir->y + cam->w.y * dir->z) >> 8;
-	pos.z += (cam->u.z * dir->x + cam->v.z * dir->y + cam->w.z * dir->z) >> 8;
+	VECTOR d;
+	d.x = (cam->u.x * dir->x + cam->v.x * dir->y + cam->w.x * dir->z) >> 8;
+	d.y = ( 0                + cam->v.y * dir->y + cam->w.y * dir->z) >> 8;
+	d.z = (cam->u.z * dir->x + cam->v.z * dir->y + cam->w.z * dir->z) >> 8;
 
 	/* update x */
-	if ((0 <= pos.x) && (pos.x <= level->a_x_range)) {
-		cam->pos.x = pos.x;
+	if ((0 <= cam->pos.x + d.x) && (cam->pos.x + d.x <= level->a_x_range)) {
+		cam->pos.x += d.x;
 	}
 
-	/* check y / z wall collision independently */
-	if ((pos.y >= 0) && (fx2int(pos.y) < level->blocks_height)) {
-		if (level->blocks[(fx2int(pos.y) * level->blocks_width) + fx2int(cam->pos.z)] == 0) {
-			cam->pos.y = pos.y;
-		}
-	}
-	if ((pos.z >= 0) && (fx2int(pos.z) < level->blocks_width)) {
-		if (level->blocks[(fx2int(cam->pos.y) * level->blocks_width) + fx2int(pos.z)] == 0) {
-			cam->pos.z = pos.z;
-		}
-	}
+	/* slide along walls in y / z */
+	col_sweep(level, &cam->pos, &d, M7_CAM_RADIUS);
 }
 
 void m7_translate_level(m7_level_t *level, const VECTOR *dir) {
@@ -76,14 +178,276 @@ void m7_translate_level(m7_level_t *level, const VECTOR *dir) {
 	cam->pos.z += ((cam->u.z * dir->x) + (cam->u.x * dir->z)) >> 8;
 }
 
+void m7_set_latch(const m7_level_t *level, FIXED dx, int dtheta) {
+	const m7_cam_t *cam = level->camera;
+
+	/* same x bounds as m7_translate_local */
+	if ((cam->pos.x + dx < 0) || (cam->pos.x + dx > level->a_x_range)) {
+		dx = 0;
+	}
+
+	/* small pitch changes just move every ray by the same number of rows:
+	   angle in radians .8f, times scanlines per unit of fov */
+	FIXED angle = (dtheta * 1608) >> 16;
+	int rows = (fxmul(angle, pre.inv_fov) * (SCREEN_HEIGHT / 2)) >> 8;
+
+	m7_latch.dx = dx * PIX_PER_BLOCK;
+	m7_latch.rows = CLAMP(rows, -M7_LATCH_MAX_ROWS, M7_LATCH_MAX_ROWS + 1);
+}
+
+void m7_hbl_monitor_init() {
+	/* free running at one tick per cycle, shared with the profiler */
+	profile_start();
+
+	m7_hbl_monitor_vbl();
+}
+
+void m7_hbl_monitor_vbl() {
+	m7_hbl_report = m7_hbl_frame;
+
+	m7_hbl_frame.late = 0;
+	m7_hbl_frame.min = 0xFFFF;
+	m7_hbl_frame.max = 0;
+	for (int i = 0; i < M7_HBL_BUCKETS; i++) {
+		m7_hbl_frame.hist[i] = 0;
+	}
+}
+
+void m7_stream_map(m7_level_t *level) {
+	if (level->strip == NULL) {
+		level->ring_pending = 0;
+		return;
+	}
+
+	/* floor (south) and ceiling (north) columns, see compute_affines */
+	int cols = level->texture_width / 8;
+	int ceil_col = level->texture_height / 8;
+	int rows = M7_CHUNK_W * PIX_PER_BLOCK / 8;
+
+	for (int slot = 0; slot < M7_WINDOW_CHUNKS; slot++) {
+		if (!(level->ring_pending & BIT(slot))) {
+			continue;
+		}
+
+		int row = level->window_chunks[slot] * rows;
+		for (int r = row; r < row + rows; r++) {
+			if ((r < 0) || (r >= level->strip_rows)) {
+				continue;
+			}
+
+			u8 *dst = &level->map[(r & (M7_RING_ROWS - 1)) * M7_MAP_W];
+			const u8 *src = &level->strip[r * cols * 2];
+			tonccpy(dst, src, cols);
+			tonccpy(dst + ceil_col, src + cols, cols);
+		}
+	}
+	level->ring_pending = 0;
+}
+
+/* object pool */
+u8 m7_obj_live[M7_OBJ_COUNT];
+int m7_obj_live_count;
+
+static u8 obj_gen[M7_OBJ_COUNT];
+static u8 obj_live_idx[M7_OBJ_COUNT]; /* position in m7_obj_live */
+static u8 obj_free[M7_OBJ_COUNT]; /* stack of free object ids */
+static int obj_free_count;
+
+void m7_init_objects(m7_level_t *level) {
+	for (int i = 0; i < level->blocks_width * level->blocks_height; i++) {
+		level->obj_cells[i] = M7_OBJ_NONE;
+	}
+
+	m7_obj_live_count = 0;
+	obj_free_count = M7_OBJ_COUNT;
+
+	for (int i = 0; i < M7_OBJ_COUNT; i++) {
+		obj_free[i] = M7_OBJ_COUNT - 1 - i;
+		obj_gen[i] = 1;
+		obj_hide(&m7_oam[i]);
+	}
+}
+
+m7_handle_t m7_spawn_object(TILE *tiles, int frame_count) {
+	if (obj_free_count == 0) {
+		return M7_HANDLE_NONE;
+	}
+
+	int obj_id = obj_free[--obj_free_count];
+	obj_live_idx[obj_id] = m7_obj_live_count;
+	m7_obj_live[m7_obj_live_count++] = obj_id;
+
+	m7_obj_meta_t *meta = &m7_obj_meta[obj_id];
+	meta->tiles = tiles;
+	meta->frame_count = frame_count;
+	meta->frame = meta->next_frame = M7_OBJ_NO_FRAME;
+	meta->block = meta->next_block = TC_NONE;
+	meta->cell = -1;
+
+	/* tile id is filled in once the first frame is cached */
+	obj_set_attr(&m7_oam[obj_id],
+		ATTR0_SQUARE | ATTR0_4BPP | ATTR0_AFF_DBL,
+		ATTR1_SIZE_32 | ATTR1_AFF_ID(obj_id),
+		0);
+	obj_hide(&m7_oam[obj_id]);
+
+	return (obj_gen[obj_id] << 8) | obj_id;
+}
+
+static void obj_unlink(m7_level_t *level, int obj_id) {
+	m7_obj_meta_t *meta = &m7_obj_meta[obj_id];
+
+	if (meta->cell_prev != M7_OBJ_NONE) {
+		m7_obj_meta[meta->cell_prev].cell_next = meta->cell_next;
+	} else {
+		level->obj_cells[meta->cell] = meta->cell_next;
+	}
+	if (meta->cell_next != M7_OBJ_NONE) {
+		m7_obj_meta[meta->cell_next].cell_prev = meta->cell_prev;
+	}
+	meta->cell = -1;
+}
+
+void m7_despawn_object(m7_level_t *level, m7_handle_t handle) {
+	int obj_id = m7_object_id(handle);
+	if (obj_id < 0) {
+		return;
+	}
+
+	m7_obj_meta_t *meta = &m7_obj_meta[obj_id];
+	if (meta->cell >= 0) {
+		obj_unlink(level, obj_id);
+	}
+	if (meta->block != TC_NONE) {
+		tc_release(meta->block);
+	}
+	if (meta->next_block != TC_NONE) {
+		tc_release(meta->next_block);
+	}
+	obj_hide(&m7_oam[obj_id]);
+
+	/* move the last live object into the hole */
+	int idx = obj_live_idx[obj_id];
+	int last = m7_obj_live[--m7_obj_live_count];
+	m7_obj_live[idx] = last;
+	obj_live_idx[last] = idx;
+
+	/* stale handles stop resolving, generation 0 is never handed out */
+	if (++obj_gen[obj_id] == 0) {
+		obj_gen[obj_id] = 1;
+	}
+	obj_free[obj_free_count++] = obj_id;
+}
+
+int m7_object_id(m7_handle_t handle) {
+	int obj_id = handle & 0xFF;
+	if ((obj_id >= M7_OBJ_COUNT) || (obj_gen[obj_id] != (handle >> 8))) {
+		return -1;
+	}
+
+	return obj_id;
+}
+
+void m7_move_object(m7_level_t *level, int obj_id, const VECTOR *pos) {
+	m7_obj_meta_t *meta = &m7_obj_meta[obj_id];
+	m7_obj_pos[obj_id] = *pos;
+
+	/* objects outside the map stay in the nearest edge block */
+	int cell = CLAMP(fx2int(pos->y), 0, level->blocks_height) * level->blocks_width
+		+ CLAMP(fx2int(pos->z), 0, level->blocks_width);
+	if (cell == meta->cell) {
+		return;
+	}
+
+	if (meta->cell >= 0) {
+		obj_unlink(level, obj_id);
+	}
+
+	/* push onto the front of the new bucket */
+	meta->cell = cell;
+	meta->cell_prev = M7_OBJ_NONE;
+	meta->cell_next = level->obj_cells[cell];
+	if (meta->cell_next != M7_OBJ_NONE) {
+		m7_obj_meta[meta->cell_next].cell_prev = obj_id;
+	}
+	level->obj_cells[cell] = obj_id;
+}
+
+int m7_query_objects(const m7_level_t *level, const VECTOR *pos, FIXED radius, u8 *ids, int max) {
+	int y_min = CLAMP(fx2int(pos->y - radius), 0, level->blocks_height);
+	int y_max = CLAMP(fx2int(pos->y + radius) + 1, 0, level->blocks_height + 1);
+	int z_min = CLAMP(fx2int(pos->z - radius), 0, level->blocks_width);
+	int z_max = CLAMP(fx2int(pos->z + radius) + 1, 0, level->blocks_width + 1);
+	FIXED radius2 = fxmul(radius, radius);
+	int count = 0;
+
+	/* only the buckets overlapping the query box */
+	for (int y = y_min; y < y_max; y++) {
+		for (int z = z_min; z < z_max; z++) {
+			int i = level->obj_cells[y * level->blocks_width + z];
+			for (; i != M7_OBJ_NONE; i = m7_obj_meta[i].cell_next) {
+				VECTOR d;
+				vec_sub(&d, &m7_obj_pos[i], pos);
+				if (fxmul(d.x, d.x) + fxmul(d.y, d.y) + fxmul(d.z, d.z) > radius2) {
+					continue;
+				}
+
+				ids[count++] = i;
+				if (count == max) {
+					return count;
+				}
+			}
+		}
+	}
+
+	return count;
+}
 
 void m7_update_objects(const m7_level_t *level) {
-	for(int i = 0; i < M7_OBJ_COUNT; i++) {
-		m7_prep_sprite(level, &m7_obj_arr[i]);
+	m7_prep_objects(level);
+}
+
+/* scales of the objects in oam and the shifts the latch gave them */
+static FIXED shown_inv_lambda[M7_OBJ_COUNT];
+static s16 shown_shift[M7_OBJ_COUNT];
+static int shown_rows;
+
+void m7_commit_objects() {
+	/* whole image at once, the multiplexer rewrites its entries after */
+	oam_copy(oam_mem, m7_oam, 128);
+
+	for (int i = 0; i < M7_OBJ_COUNT; i++) {
+		shown_inv_lambda[i] = m7_obj_inv_lambda[i];
+		shown_shift[i] = 0;
 	}
+	shown_rows = 0;
+}
 
-	/* update oam */
-	for(int i = 0; i < M7_OBJ_COUNT; i++) {
-		obj_copy(&oam_mem[i], &m7_obj_arr[i].obj, 1);
+void m7_latch_objects() {
+	/* a late strafe moves each object by the shift at its depth, like the
+	   window, and a late pitch moves them all up by the latched rows. the
+	   last commit may be a frame old, so undo the old shifts */
+	for (int i = 0; i < M7_OBJ_COUNT; i++) {
+		int shift = -fx2int(fxmul(m7_latch.dx, shown_inv_lambda[i]));
+		int x = BFN_GET(oam_mem[i].attr1, ATTR1_X) - shown_shift[i] + shift;
+		int y = BFN_GET(oam_mem[i].attr0, ATTR0_Y) + shown_rows - m7_latch.rows;
+		BFN_SET(oam_mem[i].attr1, x, ATTR1_X);
+		BFN_SET(oam_mem[i].attr0, y, ATTR0_Y);
+		shown_shift[i] = shift;
 	}
-}
\ No newline at end of file
+	shown_rows = m7_latch.rows;
+}
+
+void m7_update_billboards(const m7_level_t *level, const m7_bb_t *bbs, int count) {
+	OBJ_ATTR obj;
+	FIXED inv_lambda;
+
+	/* binned into bands and written out by the multiplexer */
+	mux_begin();
+	for (int i = 0; i < count; i++) {
+		if (m7_prep_billboard(level, &bbs[i], &obj, &inv_lambda)) {
+			mux_add(&obj, inv_lambda);
+		}
+	}
+	mux_end();
+}
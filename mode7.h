@@ -7,6 +7,26 @@
 #define PIX_PER_BLOCK 16
 
 #define M7_OBJ_COUNT 32
+#define M7_OBJ_FRAME_TILES 16 /* tiles per frame (4bpp 32x32) */
+#define M7_OBJ_NO_FRAME 0xFF
+#define M7_OBJ_NONE 0xFF /* end of a cell bucket */
+
+#define M7_BLOCK_END 1 /* "end, no texture", also outside the block window */
+#define M7_CHUNK_W 16 /* block columns (z) per chunk */
+#define M7_WINDOW_CHUNKS 4 /* chunks around the camera, power of two */
+#define M7_WINDOW_W (M7_CHUNK_W * M7_WINDOW_CHUNKS)
+#define M7_CHUNK_NONE 0x7FFF
+#define M7_MAX_WIDTH 1024 /* level blocks along z, cell indices fit an s16 */
+#define M7_MAX_HEIGHT 16 /* level blocks along y, sizes the block window buffers */
+#define M7_CAM_RADIUS 0x40 /* collision half size of the camera, blocks .8f */
+#define M7_MAP_W 128 /* affine map, tiles */
+#define M7_RING_ROWS (M7_WINDOW_W * PIX_PER_BLOCK / 8) /* map rows streamed levels keep */
+#define M7_LATCH_MAX_ROWS 4 /* largest late pitch correction, scanlines. the edge rows repeat */
+#define M7_RACE_MARGIN (M7_LATCH_MAX_ROWS + 2) /* lines kept between the beam and rows rebuilt behind it */
+
+// #define M7_HBL_MONITOR /* time m7_hbl on timer 2, see m7_hbl_report */
+#define M7_HBL_BUCKETS 16
+#define M7_HBL_BUCKET_SHIFT 5 /* cycles per histogram bucket, log2 */
 
 #define M7_D 160 /* focal length */
 #define M7_D_SHIFT 8 /* focal shift */
@@ -33,29 +53,130 @@ typedef struct _m7_cam_t {
 	FIXED fov;
 } m7_cam_t;
 
+/* texture atlas origin of each side of a block, in pixels. indexed by
+   block code, sides in raycast order: north (ceiling), south (floor),
+   east, west */
+typedef struct _m7_material_t {
+	POINT16 sides[4];
+} m7_material_t;
+
+/* lateral span of a wall, x in blocks from the level center and half
+   width scaled by fov */
+typedef struct _m7_extent_t {
+	FIXED width, off;
+} m7_extent_t;
+
 typedef struct _m7_level_t {
 	m7_cam_t *camera;
 	u16 *winh; /* window 0 widths */
 
 	BG_AFFINE *bgaff; /* affine parameter array */
+	FIXED *inv_lambda; /* screen pixels per texel, 0 on lines without a hit */
 	u16 bgcnt; /* BGxCNT for floor */
 
-	const int *blocks;
+	/* the world is stored in rom as chunks of M7_CHUNK_W columns, blocks is
+	   a window of them around the camera indexed with wrapped z */
+	u8 *blocks;
+	const u8 *chunks;
+	int window_z; /* first column in the window */
+	s16 window_chunks[M7_WINDOW_CHUNKS]; /* chunk held by each slot */
+	u16 *solid; /* solidity bits of the window, see collide.h */
+	u8 ring_pending; /* slots whose map rows are not streamed yet */
+
+	/* long levels stream floor / ceiling map rows in z order from the strip
+	   into a ring in the map. NULL when the whole texture fits */
+	u8 *map;
+	const u8 *strip;
+	int strip_rows;
 	int blocks_width, blocks_height;
 	FIXED pixels_per_block, a_x_range;
 	int texture_width, texture_height;
-	const FIXED *extent_widths, *extent_offs;
+	const m7_extent_t *extents;
+	const u8 *extent_ids; /* extent of each block, row major over the padded width */
+	const m7_material_t *materials;
+	u8 *obj_cells; /* first object id in each block, for objects in this level */
 } m7_level_t;
 
-typedef struct _m7_obj_t {
-	VECTOR pos;
+/* generation in the high byte, slot in the low byte */
+typedef u16 m7_handle_t;
+#define M7_HANDLE_NONE 0
+
+/* objects are stored as parallel arrays indexed by object id:
+   positions for the projection pass, an oam image for the commit,
+   and everything else here */
+typedef struct _m7_obj_meta_t {
 	POINT anchor;
-	OBJ_ATTR obj;
 	s16 phi;
-	u8 obj_id;
-	u8 aff_id;
-	TILE *tiles;
-} m7_obj_t;
+	TILE *tiles; /* first frame of the direction strip */
+	u8 frame_count; /* directions covering the full circle */
+	u8 frame, block; /* displayed frame and its tile cache block */
+	u8 next_frame, next_block; /* frame waiting for upload */
+	s16 cell; /* block the object is bucketed in, -1 if not placed */
+	u8 cell_prev, cell_next;
+} m7_obj_meta_t;
+
+/* binary level container, compiled from tiled by gfx/tmx2level.py.
+   used in place from rom: every section is word aligned and addressed
+   by its offset from the start of the header */
+#define M7_LEVEL_MAGIC 0x564C374D /* "M7LV" */
+#define M7_LEVEL_VERSION 7
+
+typedef struct _m7_level_hdr_t {
+	u32 magic;
+	u16 version, header_size;
+	u16 blocks_width, blocks_height;
+	u16 texture_width, texture_height;
+	u16 spawn_count, strip_rows;
+	u32 floor_blocks, wall_blocks; /* u8 block codes, in chunks */
+	u32 floor_extents, floor_extent_ids; /* m7_extent_t, fov scaled / u8 per block */
+	u32 wall_extents, wall_extent_ids;
+	u32 spawns; /* m7_spawn_t */
+	u32 floor_materials, wall_materials; /* m7_material_t per block code */
+	u32 pal, tiles, map; /* hlz compressed, see lzstream.h */
+	u32 floor_strip, wall_strip; /* 0 when not streamed */
+} m7_level_hdr_t;
+
+#define M7_LEVEL_PTR(hdr, section) ((const void*)((const u8*)(hdr) + (hdr)->section))
+
+typedef struct _m7_spawn_t {
+	VECTOR pos;
+	s16 anchor_x, anchor_y;
+	s16 phi;
+	u8 sheet; /* index into the sheets given when spawning */
+	u8 frame_count;
+	u16 first; /* first frame of the direction strip */
+	u16 pad;
+} m7_spawn_t;
+
+typedef struct _m7_bb_t {
+	VECTOR pos;
+	POINT anchor;
+	OBJ_ATTR obj; /* regular sprite, position is filled in */
+} m7_bb_t;
+
+/* input read after the tables were built, applied by m7_hbl as a shift in
+   x (texture pixels .8f) and a row offset into the tables for pitch */
+typedef struct {
+	FIXED dx;
+	int rows;
+} m7_latch_t;
+
+/* progress of the tables being built. m7_prep_lines can run a few rows at a
+   time, behind the beam for the next frame or ahead of it for this one */
+typedef struct {
+	m7_level_t *levels[2];
+	int row; /* rows built so far */
+	u8 live; /* the frame being built is on screen */
+	volatile u32 late; /* lines shown before their row was built */
+} m7_race_t;
+
+/* hblank isr timing over one frame, in cycles from entry to exit. late
+   lines had their registers written after they started drawing */
+typedef struct {
+	u16 late;
+	u16 min, max;
+	u16 hist[M7_HBL_BUCKETS];
+} m7_hbl_report_t;
 
 typedef struct {
 	FIXED inv_fov;
@@ -64,23 +185,61 @@ typedef struct {
 } m7_precompute;
 
 /* accessible both from main and iwram */
-extern m7_obj_t m7_obj_arr[M7_OBJ_COUNT];
+extern VECTOR m7_obj_pos[M7_OBJ_COUNT]; /* in iwram */
+extern OBJ_ATTR m7_oam[128]; /* object i uses entry and matrix i */
+#define m7_obj_aff ((OBJ_AFFINE*)m7_oam)
+extern m7_obj_meta_t m7_obj_meta[M7_OBJ_COUNT];
+extern FIXED m7_obj_inv_lambda[M7_OBJ_COUNT]; /* screen pixels per texture pixel, as last shown */
+extern u8 m7_obj_live[M7_OBJ_COUNT]; /* dense list of live object ids */
+extern int m7_obj_live_count;
 extern m7_level_t floor_level, wall_level;
 extern m7_precompute pre;
+extern m7_latch_t m7_latch;
+extern m7_race_t m7_race;
+extern m7_hbl_report_t m7_hbl_report; /* last frame */
+extern m7_hbl_report_t m7_hbl_frame; /* frame being timed */
 
 /* level functions */
-void m7_init(m7_level_t *level, m7_cam_t *cam, BG_AFFINE bgaff[], u16 *winh_arr, u16 bgcnt, int bgno);
+void m7_init(m7_level_t *level, m7_cam_t *cam, BG_AFFINE bgaff[], u16 *winh_arr, FIXED *inv_lambda_arr, u16 bgcnt, int bgno);
+int m7_load_level(m7_level_t *floor, m7_level_t *wall, const m7_level_hdr_t *hdr);
+void m7_init_window(m7_level_t *level, u8 *blocks_buf, u16 *solid_buf);
+void m7_update_window(m7_level_t *level);
+void m7_stream_map(m7_level_t *level);
+void m7_hbl_monitor_init();
+void m7_hbl_monitor_vbl();
+
+INLINE int m7_block(const m7_level_t *level, int y, int z) {
+	if ((u32)(z - level->window_z) >= M7_WINDOW_W) {
+		return M7_BLOCK_END;
+	}
+	return level->blocks[y * M7_WINDOW_W + (z & (M7_WINDOW_W - 1))];
+}
+void m7_spawn_level_objects(m7_level_t *level, const m7_level_hdr_t *hdr, TILE *const sheets[]);
 
 /* camera functions */
 void m7_rotate(m7_cam_t *cam, int theta);
 void m7_translate_local(m7_level_t *level, const VECTOR *dir);
 void m7_translate_level(m7_level_t *level, const VECTOR *dir);
+void m7_set_latch(const m7_level_t *level, FIXED dx, int dtheta);
 
 /* object functions */
+void m7_init_objects(m7_level_t *level);
+m7_handle_t m7_spawn_object(TILE *tiles, int frame_count);
+void m7_despawn_object(m7_level_t *level, m7_handle_t handle);
+int m7_object_id(m7_handle_t handle);
+void m7_move_object(m7_level_t *level, int obj_id, const VECTOR *pos);
+int m7_query_objects(const m7_level_t *level, const VECTOR *pos, FIXED radius, u8 *ids, int max);
 void m7_update_objects(const m7_level_t * level);
+void m7_commit_objects();
+void m7_latch_objects();
+void m7_update_billboards(const m7_level_t *level, const m7_bb_t *bbs, int count);
 
 /* iwram code */
 IWRAM_CODE void m7_prep_affines(m7_level_t *level_2, m7_level_t *level_3);
+IWRAM_CODE void m7_prep_begin(m7_level_t *level_2, m7_level_t *level_3);
+IWRAM_CODE void m7_prep_lines(int end);
 IWRAM_CODE void m7_hbl();
+IWRAM_CODE void m7_prep_objects(const m7_level_t *level);
+IWRAM_CODE int m7_prep_billboard(const m7_level_t *level, const m7_bb_t *bb, OBJ_ATTR *obj, FIXED *inv_lambda);
 
 #endif
\ No newline at end of file
@@ -1,6 +1,10 @@
 #include <tonc.h>
 
 #include "mode7.h"
+#include "objmux.h"
+#include "profile.h"
+#include "tilecache.h"
+#include "trace.h"
 
 #define RAYCAST_FREQ 1
 
@@ -34,26 +38,70 @@ typedef struct {
 	FIXED perp_wall_dist;
 	FIXED dist_y, dist_z;
 	int map_y, map_z;
+	int block; /* code of the block hit */
 } raycast_output_t;
 
 IWRAM_CODE static void init_raycast(const m7_cam_t *cam, int h, raycast_input_t *rin_ptr);
 IWRAM_CODE static int raycast(const m7_level_t *level, const raycast_input_t *rin, raycast_output_t *rout_ptr);
 IWRAM_CODE static void compute_affines(const m7_level_t *level, const raycast_input_t *rin, const raycast_output_t *rout, FIXED lambda, BG_AFFINE *bg_aff_ptr);
-IWRAM_CODE static void compute_windows(const m7_level_t *level, int map_y, FIXED lambda, u16 *winh_ptr);
-IWRAM_CODE void m7_prep_sprite(const m7_level_t *level, m7_obj_t *spr);
+IWRAM_CODE static void compute_windows(const m7_level_t *level, const raycast_output_t *rout, FIXED inv_lambda, u16 *winh_ptr);
+
+/* object prototypes */
+
+static u8 vis_ids[M7_OBJ_COUNT]; /* objects shown last frame */
+static int vis_count;
+
+IWRAM_CODE static int prep_object(const m7_cam_t *cam, int obj_id);
+IWRAM_CODE static int select_frame(int obj_id, u16 view);
+
+/* instrumentation prototypes */
+
+#ifdef M7_HBL_MONITOR
+IWRAM_CODE static void hbl_monitor(int vc, int late, u32 cycles);
+#endif
 
 /* public function implementations */
 
 IWRAM_CODE void
 m7_hbl() {
+	PROF_BEGIN(isr_start);
+#ifdef M7_HBL_MONITOR
+	u16 entry = REG_TM2D;
+	int in_hbl = REG_DISPSTAT & DSTAT_IN_HBL;
+#endif
 	int vc = REG_VCOUNT;
 
+	/* table row for the next line, moved by the late latched pitch. drawn
+	   lines stay on drawn rows, the ones past the screen get the copy of
+	   row 0 in the extra row */
+	int line = (vc == 227) ? 0 : vc + 1;
+	int row = SCREEN_HEIGHT;
+	if (line < SCREEN_HEIGHT) {
+		row = CLAMP(line + m7_latch.rows, 0, SCREEN_HEIGHT);
+	}
+
+	/* count rows the beam got to before prep did */
+	if (vc == 227) {
+		m7_race.live = 1;
+	}
+	if (m7_race.live && (row < SCREEN_HEIGHT) && (row >= m7_race.row)) {
+		m7_race.late++;
+	}
+
 	/* apply wall (secondary) affine */
 	BG_AFFINE *bga;
-	REG_BG_AFFINE[3] = wall_level.bgaff[vc + 1];
-
-	/* hide the wall (bg2) if applicable by flipping to mode 1 */
-	bga = &wall_level.bgaff[(vc + 2) > SCREEN_HEIGHT ? 0 : vc + 2];
+	REG_BG_AFFINE[3] = wall_level.bgaff[row];
+	REG_BG3X = wall_level.bgaff[row].dx + m7_latch.dx;
+
+	/* hide the wall (bg2) if applicable by flipping to mode 1. the row
+	   ahead stays on drawn rows as well */
+	int ahead = row + 1;
+	if (row == SCREEN_HEIGHT) {
+		ahead = 0;
+	} else if (ahead == SCREEN_HEIGHT) {
+		ahead = SCREEN_HEIGHT - 1;
+	}
+	bga = &wall_level.bgaff[ahead];
 	static int wall_hidden = 0;
 	if (!wall_hidden && (bga->pa == 0)) {
 		REG_DISPCNT = (REG_DISPCNT & ~DCNT_MODE2) | DCNT_MODE1;
@@ -64,8 +112,9 @@ m7_hbl() {
 	}
 
 	/* apply floor (primary) affine */
-	bga = &floor_level.bgaff[vc + 1];
+	bga = &floor_level.bgaff[row];
 	REG_BG_AFFINE[2] = *bga;
+	REG_BG2X = bga->dx + m7_latch.dx;
 
 	/* apply shading */
 	u32 ey = bga->pb >> 7;
@@ -73,57 +122,119 @@ m7_hbl() {
 	REG_BLDY = BLDY_BUILD(ey);
 
 	/* apply windowing */
+	u16 winh;
 	if (!wall_hidden) {
 		/* todo: use win0 and win1 instead of just combining into win0 */
-		u8 draw_start = MIN(floor_level.winh[vc + 1] >> 8, wall_level.winh[vc + 1] >> 8);
-		u8 draw_end  = MAX(floor_level.winh[vc + 1] & 0xFF, wall_level.winh[vc + 1] & 0xFF);
-		REG_WIN0H = WIN_BUILD(draw_end, draw_start);
+		u8 draw_start = MIN(floor_level.winh[row] >> 8, wall_level.winh[row] >> 8);
+		u8 draw_end  = MAX(floor_level.winh[row] & 0xFF, wall_level.winh[row] & 0xFF);
+		winh = WIN_BUILD(draw_end, draw_start);
 	} else {
-		REG_WIN0H = floor_level.winh[vc + 1];
+		winh = floor_level.winh[row];
+	}
+
+	/* a late strafe slides the window by the shift in screen pixels */
+	if (m7_latch.dx != 0) {
+		int shift = -fx2int(fxmul(m7_latch.dx, floor_level.inv_lambda[row]));
+		int draw_start = CLAMP((winh >> 8) + shift, 0, SCREEN_WIDTH + 1);
+		int draw_end = CLAMP((winh & 0xFF) + shift, 0, SCREEN_WIDTH + 1);
+		winh = WIN_BUILD(draw_end, draw_start);
 	}
+	REG_WIN0H = winh;
+
+#ifdef M7_HBL_MONITOR
+	/* entered after the line started, or still writing when the next did */
+	int late = !in_hbl || (REG_VCOUNT != vc);
+#endif
+
+	/* oam writes last, they are the least timing critical */
+	mux_hbl(vc);
+
+#ifdef M7_HBL_MONITOR
+	hbl_monitor(vc, late, (u16)(REG_TM2D - entry));
+#endif
+	PROF_END(PROF_ISR, isr_start);
 }
 
 IWRAM_CODE void
 m7_prep_affines(m7_level_t *level_2, m7_level_t *level_3) {
+	m7_prep_begin(level_2, level_3);
+	m7_prep_lines(SCREEN_HEIGHT);
+
+	/* built for the next frame shown */
+	m7_race.live = 1;
+}
+
+IWRAM_CODE void
+m7_prep_begin(m7_level_t *level_2, m7_level_t *level_3) {
+	m7_race.levels[0] = level_2;
+	m7_race.levels[1] = level_3;
+	m7_race.row = 0;
+	m7_race.live = 0;
+}
+
+IWRAM_CODE void
+m7_prep_lines(int end) {
 	raycast_input_t rin;
 	raycast_output_t routs[2];
-	m7_level_t *levels[2] = {level_2, level_3};
+	m7_level_t *const *levels = m7_race.levels;
 
-	m7_cam_t *cam = level_2->camera;
+	m7_cam_t *cam = levels[0]->camera;
 
-	for (int h = 0; h < SCREEN_HEIGHT; h += RAYCAST_FREQ) {
+	int h;
+	for (h = m7_race.row; h < end; h += RAYCAST_FREQ) {
+		PROF_BEGIN(init_start);
 		init_raycast(cam, h, &rin);
+		PROF_END(PROF_RAYCAST, init_start);
 
 		FIXED lambda = 0;
 		for (int bg = 0; bg < 2; bg++) {
 			/* compute the affines / windows only if raycast finds a renderable wall */
-			if (raycast(levels[bg], &rin, &routs[bg])) {
+			PROF_BEGIN(ray_start);
+			int hit = raycast(levels[bg], &rin, &routs[bg]);
+			PROF_END(PROF_RAYCAST, ray_start);
+
+			if (hit) {
+				PROF_BEGIN(aff_start);
 				lambda = fxmul(routs[bg].perp_wall_dist, pre.inv_fov_x_ppb);
+				if (lambda == 0) {
+					/* wall within 1/32 block, the reciprocal needs it nonzero */
+					lambda = 1;
+				}
+				levels[bg]->inv_lambda[h] = fxdiv(int2fx(1), lambda);
 
 				compute_affines(levels[bg], &rin, &routs[bg], lambda, &levels[bg]->bgaff[h]);
+				PROF_END(PROF_AFFINE, aff_start);
 
 				/* extent will correctly size window (texture can be transparent) */
-				compute_windows(levels[bg], routs[bg].map_y, lambda, &levels[bg]->winh[h]);
+				PROF_BEGIN(win_start);
+				compute_windows(levels[bg], &routs[bg], levels[bg]->inv_lambda[h], &levels[bg]->winh[h]);
+				PROF_END(PROF_WINDOW, win_start);
 			} else {
 				levels[bg]->bgaff[h].pa = 0;
 				levels[bg]->winh[h]     = WIN_BUILD(M7_RIGHT, M7_RIGHT);
+				levels[bg]->inv_lambda[h] = 0;
 			}
 
 			/* duplicate affine matrices if rendering low-res */
 			for (int i = 1; i < RAYCAST_FREQ; i++) {
 				levels[bg]->bgaff[h + i] = levels[bg]->bgaff[h];
 				levels[bg]->winh[h + i]  = levels[bg]->winh[h];
+				levels[bg]->inv_lambda[h + i] = levels[bg]->inv_lambda[h];
 			}
 		}
 
 		/* for shading. pb and pd aren't used (q_y is implicitly zero) */
-		level_3->bgaff[h].pb = lambda;
+		levels[1]->bgaff[h].pb = lambda;
 	}
+	m7_race.row = MAX(h, m7_race.row);
 
 	/* needed to correctly scale last scanline */
-	for (int bg = 0; bg < 2; bg++) {
-		levels[bg]->bgaff[SCREEN_HEIGHT] = levels[bg]->bgaff[0];
-		levels[bg]->winh[SCREEN_HEIGHT]  = levels[bg]->winh[0];
+	if (m7_race.row >= SCREEN_HEIGHT) {
+		for (int bg = 0; bg < 2; bg++) {
+			levels[bg]->bgaff[SCREEN_HEIGHT] = levels[bg]->bgaff[0];
+			levels[bg]->winh[SCREEN_HEIGHT]  = levels[bg]->winh[0];
+			levels[bg]->inv_lambda[SCREEN_HEIGHT] = levels[bg]->inv_lambda[0];
+		}
 	}
 }
 
@@ -193,6 +304,7 @@ raycast(const m7_level_t *level, const raycast_input_t *rin, raycast_output_t *r
 	int hit = 0;
 
 	while (!hit) {
+		TR_ADD(dda_steps, 1);
 		if (rout.dist_y < rout.dist_z) {
 			rout.dist_y += rin->delta_dist_y;
 			rout.map_y  += rin->delta_map_y;
@@ -201,11 +313,16 @@ raycast(const m7_level_t *level, const raycast_input_t *rin, raycast_output_t *r
 			rout.dist_z += rin->delta_dist_z;
 			rout.map_z  += rin->delta_map_z;
 			rout.side    = (rin->delta_map_z < 0) ? W_SIDE : E_SIDE;
+
+			/* ran off the block window */
+			if ((u32)(rout.map_z - level->window_z) >= M7_WINDOW_W) {
+				return 0;
+			}
 		}
 
-		if ((hit = level->blocks[rout.map_y * level->blocks_width + rout.map_z])) {
+		if ((hit = level->blocks[rout.map_y * M7_WINDOW_W + (rout.map_z & (M7_WINDOW_W - 1))])) {
 			/* defined raycast map value 1 to be "end, no texture" */
-			if (hit == 1) {
+			if (hit == M7_BLOCK_END) {
 				return 0;
 			}
 		}
@@ -226,6 +343,7 @@ raycast(const m7_level_t *level, const raycast_input_t *rin, raycast_output_t *r
 			rin->inv_ray_z);
 	}
 	if (rout.perp_wall_dist == 0) { rout.perp_wall_dist = 1; }
+	rout.block = hit;
 
 	/* apply raytrace result */
 	*rout_ptr = rout;
@@ -247,12 +365,9 @@ compute_affines(const m7_level_t *level, const raycast_input_t *rin, const rayca
 	/* camera x-position */
 	bg_aff_ptr->dx = fxadd(fxmul(lambda, int2fx(M7_LEFT)), a_x * PIX_PER_BLOCK);
 
-	/* move side to correct texture source */
-	if (((rout->side == E_SIDE) || (rout->side == W_SIDE))) {
-		bg_aff_ptr->dx += int2fx(level->texture_width);
-	} else if (rout->side == N_SIDE) {
-		bg_aff_ptr->dx += int2fx(level->texture_height);
-	}
+	/* move to the material's texture for this side */
+	const POINT16 *origin = &level->materials[rout->block].sides[rout->side];
+	bg_aff_ptr->dx += int2fx(origin->x);
 
 	/* calculate angle corrections (angles are .12f) */
 	FIXED correction;
@@ -266,34 +381,41 @@ compute_affines(const m7_level_t *level, const raycast_input_t *rin, const rayca
 	/* apply correction */
 	bg_aff_ptr->dy = correction;
 
+	/* streamed floors / ceilings sit in a ring of map rows, in z order. the
+	   reference point is reset every line, so masking dy does the wrap */
+	if (level->strip && ((rout->side == N_SIDE) || (rout->side == S_SIDE))) {
+		bg_aff_ptr->dy &= int2fx(M7_RING_ROWS * 8) - 1;
+		return;
+	}
+
 	/* wrap texture for ceiling */
 	if ((((rout->side == N_SIDE) || (rout->side == S_SIDE)) && (rin->ray_y > 0)) ||
 		(((rout->side == E_SIDE) || (rout->side == W_SIDE)) && (rin->ray_z < 0))) {
 		bg_aff_ptr->dy = fxsub(int2fx(level->texture_height), bg_aff_ptr->dy);
 	}
 
-	/* offset down for bg2 */
-	if (level->bgcnt & BG_PRIO(1)) {
-		bg_aff_ptr->dy += int2fx(level->texture_height);
-	}
+	/* the material table also places bg3 below bg2 */
+	bg_aff_ptr->dy += int2fx(origin->y);
 }
 
 IWRAM_CODE static void
-compute_windows(const m7_level_t *level, int map_y, FIXED lambda, u16 *winh_ptr) {
+compute_windows(const m7_level_t *level, const raycast_output_t *rout, FIXED inv_lambda, u16 *winh_ptr) {
+	/* span of the block that was hit */
+	const m7_extent_t *ext = &level->extents[
+		level->extent_ids[rout->map_y * level->blocks_width + rout->map_z]];
+
 	FIXED a_x_offs = fxsub(
-		level->extent_offs[map_y], // origin relative to center of level
+		ext->off, // origin relative to center of level
 		level->camera->pos.x // adjust by camera position
 	) * PIX_PER_BLOCK; // scale up to block size
 
-	FIXED inv_lambda = fxdiv(int2fx(1), lambda);
-
 	int draw_start = 1 + M7_RIGHT + fx2int(
 		fxmul(
-			fxsub(a_x_offs, level->extent_widths[map_y]),
+			fxsub(a_x_offs, ext->width),
 			inv_lambda));
 	int draw_end = M7_RIGHT + fx2int(
 		fxmul(
-			fxadd(a_x_offs, level->extent_widths[map_y]),
+			fxadd(a_x_offs, ext->width),
 			inv_lambda));
 
 	/* clamp to screen size */
@@ -304,6 +426,189 @@ compute_windows(const m7_level_t *level, int map_y, FIXED lambda, u16 *winh_ptr)
 }
 
 IWRAM_CODE void
-m7_prep_sprite(const m7_level_t *level, m7_obj_t *spr) {
-	
-}
\ No newline at end of file
+m7_prep_objects(const m7_level_t *level) {
+	const m7_cam_t *cam = level->camera;
+
+	/* hide what was shown last frame, the visible buckets bring it back */
+	for (int n = 0; n < vis_count; n++) {
+		obj_hide(&m7_oam[vis_ids[n]]);
+	}
+	vis_count = 0;
+
+	/* view wedge in the y / z plane: apex at the camera, edges along w +- fov * v */
+	FIXED far = int2fx(M7_FAR_OBJ) / PIX_PER_BLOCK;
+	FIXED margin = int2fx(2); /* block radius plus sprite size */
+	FIXED edge_y = fxmul(cam->fov, cam->v.y);
+	FIXED edge_z = fxmul(cam->fov, cam->v.z);
+	FIXED left_y = cam->w.y - edge_y, left_z = cam->w.z - edge_z;
+	FIXED right_y = cam->w.y + edge_y, right_z = cam->w.z + edge_z;
+
+	/* bounding box of the wedge, in blocks */
+	FIXED y_lo = MIN(0, MIN(left_y, right_y)), y_hi = MAX(0, MAX(left_y, right_y));
+	FIXED z_lo = MIN(0, MIN(left_z, right_z)), z_hi = MAX(0, MAX(left_z, right_z));
+	int y_min = CLAMP(fx2int((cam->pos.y + fxmul(far, y_lo) - margin)), 0, level->blocks_height);
+	int y_max = CLAMP(fx2int((cam->pos.y + fxmul(far, y_hi) + margin)) + 1, 0, level->blocks_height + 1);
+	int z_min = CLAMP(fx2int((cam->pos.z + fxmul(far, z_lo) - margin)), 0, level->blocks_width);
+	int z_max = CLAMP(fx2int((cam->pos.z + fxmul(far, z_hi) + margin)) + 1, 0, level->blocks_width + 1);
+
+	for (int y = y_min; y < y_max; y++) {
+		const u8 *cells = &level->obj_cells[y * level->blocks_width];
+
+		/* camera space of the block centers, stepped along z */
+		FIXED r_y = int2fx(y) + int2fx(1) / 2 - cam->pos.y;
+		FIXED r_z = int2fx(z_min) + int2fx(1) / 2 - cam->pos.z;
+		FIXED depth = fxmul(r_y, cam->w.y) + fxmul(r_z, cam->w.z);
+		FIXED lateral = fxmul(r_y, cam->v.y) + fxmul(r_z, cam->v.z);
+
+		for (int z = z_min; z < z_max; z++, depth += cam->w.z, lateral += cam->v.z) {
+			if (cells[z] == M7_OBJ_NONE) {
+				continue;
+			}
+
+			if ((depth < -margin) || (depth > far + margin) ||
+				(ABS(lateral) > fxmul(cam->fov, depth) + margin)) {
+				continue;
+			}
+
+			for (int i = cells[z]; i != M7_OBJ_NONE; i = m7_obj_meta[i].cell_next) {
+				if (prep_object(cam, i)) {
+					vis_ids[vis_count++] = i;
+				}
+			}
+		}
+	}
+}
+
+IWRAM_CODE static int
+prep_object(const m7_cam_t *cam, int obj_id) {
+	OBJ_ATTR *obj = &m7_oam[obj_id];
+
+	/* convert to camera frame */
+	VECTOR vr;
+	vec_sub(&vr, &m7_obj_pos[obj_id], &cam->pos);
+	FIXED y_c = vec_dot(&vr, &cam->v);
+	FIXED z_c = vec_dot(&vr, &cam->w);
+
+	/* near / far planes are in pixels, positions in blocks */
+	if ((z_c < int2fx(M7_NEAR) / PIX_PER_BLOCK) || (z_c > int2fx(M7_FAR_OBJ) / PIX_PER_BLOCK)) {
+		return 0;
+	}
+
+	/* texture pixels per screen pixel, same scale as the floor */
+	FIXED lambda = fxmul(z_c, pre.inv_fov_x_ppb);
+
+	/* project anchor, then move to the top left of the double-size box */
+	const POINT *anchor = &m7_obj_meta[obj_id].anchor;
+	int sx = M7_RIGHT + (vr.x * PIX_PER_BLOCK) / lambda;
+	int sy = M7_TOP + (y_c * M7_D) / z_c;
+	int w = obj_get_width(obj), h = obj_get_height(obj);
+	sx += ((w / 2 - anchor->x) << FSH) / lambda - w;
+	sy += ((h / 2 - anchor->y) << FSH) / lambda - h;
+
+	if ((sx <= -2 * w) || (sx >= SCREEN_WIDTH) || (sy <= -2 * h) || (sy >= SCREEN_HEIGHT)) {
+		return 0;
+	}
+
+	/* first frame may still be on its way */
+	if (!select_frame(obj_id, ArcTan2(vr.z, vr.x))) {
+		return 0;
+	}
+
+	obj_aff_scale_inv(&m7_obj_aff[obj_id], lambda, lambda);
+	obj_unhide(obj, ATTR0_AFF_DBL);
+	obj_set_pos(obj, sx, sy);
+	m7_obj_inv_lambda[obj_id] = fxdiv(int2fx(1), lambda);
+
+	return 1;
+}
+
+IWRAM_CODE static int
+select_frame(int obj_id, u16 view) {
+	m7_obj_meta_t *meta = &m7_obj_meta[obj_id];
+
+	/* pick the frame facing the camera */
+	uint rel = (u16)(meta->phi - view + (0x8000 / meta->frame_count));
+	uint frame = (rel * meta->frame_count) >> 16;
+
+	if (frame == meta->frame) {
+		/* turned back before the pending frame arrived */
+		if (meta->next_block != TC_NONE) {
+			tc_release(meta->next_block);
+			meta->next_block = TC_NONE;
+			meta->next_frame = M7_OBJ_NO_FRAME;
+		}
+	} else if (frame != meta->next_frame) {
+		if (meta->next_block != TC_NONE) {
+			tc_release(meta->next_block);
+		}
+		/* cache may be full, try again next frame */
+		meta->next_block = tc_acquire(&meta->tiles[frame * M7_OBJ_FRAME_TILES]);
+		meta->next_frame = (meta->next_block == TC_NONE) ? M7_OBJ_NO_FRAME : frame;
+	}
+
+	/* keep showing the old frame until the new one is uploaded */
+	if ((meta->next_block != TC_NONE) && tc_ready(meta->next_block)) {
+		if (meta->block != TC_NONE) {
+			tc_release(meta->block);
+		}
+		meta->block = meta->next_block;
+		meta->frame = meta->next_frame;
+		meta->next_block = TC_NONE;
+		meta->next_frame = M7_OBJ_NO_FRAME;
+		BFN_SET(m7_oam[obj_id].attr2, tc_tile_id(meta->block), ATTR2_ID);
+	}
+
+	if (meta->block == TC_NONE) {
+		return 0;
+	}
+	tc_touch(meta->block);
+
+	return 1;
+}
+
+IWRAM_CODE int
+m7_prep_billboard(const m7_level_t *level, const m7_bb_t *bb, OBJ_ATTR *obj, FIXED *inv_lambda) {
+	m7_cam_t *cam = level->camera;
+
+	/* convert to camera frame */
+	VECTOR vr;
+	vec_sub(&vr, &bb->pos, &cam->pos);
+	FIXED y_c = vec_dot(&vr, &cam->v);
+	FIXED z_c = vec_dot(&vr, &cam->w);
+
+	if ((z_c < int2fx(M7_NEAR) / PIX_PER_BLOCK) || (z_c > int2fx(M7_FAR_OBJ) / PIX_PER_BLOCK)) {
+		return 0;
+	}
+
+	/* billboards aren't scaled, only the anchor is projected */
+	FIXED lambda = fxmul(z_c, pre.inv_fov_x_ppb);
+	int sx = M7_RIGHT + (vr.x * PIX_PER_BLOCK) / lambda - bb->anchor.x;
+	int sy = M7_TOP + (y_c * M7_D) / z_c - bb->anchor.y;
+
+	if ((sx <= -obj_get_width(&bb->obj)) || (sx >= SCREEN_WIDTH) ||
+		(sy <= -obj_get_height(&bb->obj)) || (sy >= SCREEN_HEIGHT)) {
+		return 0;
+	}
+
+	*obj = bb->obj;
+	obj_set_pos(obj, sx, sy);
+	*inv_lambda = fxdiv(int2fx(1), lambda);
+
+	return 1;
+}
+
+/* instrumentation implementations */
+
+#ifdef M7_HBL_MONITOR
+IWRAM_CODE static void hbl_monitor(int vc, int late, u32 cycles) {
+	/* only lines that are drawn */
+	if ((vc >= SCREEN_HEIGHT - 1) && (vc != 227)) {
+		return;
+	}
+
+	m7_hbl_frame.late += late;
+	m7_hbl_frame.min = MIN(m7_hbl_frame.min, cycles);
+	m7_hbl_frame.max = MAX(m7_hbl_frame.max, cycles);
+	m7_hbl_frame.hist[MIN(cycles >> M7_HBL_BUCKET_SHIFT, M7_HBL_BUCKETS - 1)]++;
+}
+#endif
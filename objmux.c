@@ -0,0 +1,93 @@
+#include <tonc.h>
+
+#include "objmux.h"
+
+mux_frame_t mux_frames[2];
+int mux_front;
+int mux_target, mux_written, mux_late;
+
+mux_report_t mux_report;
+
+static int mux_ready;
+
+void mux_begin() {
+	mux_frame_t *back = &mux_frames[mux_front ^ 1];
+
+	for (int b = 0; b < MUX_BANDS; b++) {
+		back->counts[b] = 0;
+	}
+	back->submitted = 0;
+	back->drop_oam = 0;
+
+	mux_ready = 0;
+}
+
+void mux_add(const OBJ_ATTR *obj, FIXED inv_lambda) {
+	mux_frame_t *back = &mux_frames[mux_front ^ 1];
+	int y = BFN_GET(obj->attr0, ATTR0_Y);
+	int h = obj_get_height(obj);
+
+	back->submitted++;
+
+	/* a taller sprite would still be showing when its set is rewritten */
+	if (h > MUX_BAND_HEIGHT) {
+		back->drop_oam++;
+		return;
+	}
+
+	/* y wraps, anything hanging over the top belongs to the first band */
+	int band;
+	if (y < SCREEN_HEIGHT) {
+		band = y >> MUX_BAND_SHIFT;
+	} else if (y + h > 256) {
+		band = 0;
+	} else {
+		return;
+	}
+
+	if (back->counts[band] == MUX_SET_SIZE) {
+		back->drop_oam++;
+		return;
+	}
+	back->inv_lambda[band][back->counts[band]] = inv_lambda;
+	obj_copy(&back->bands[band][back->counts[band]++], obj, 1);
+}
+
+void mux_end() {
+	mux_ready = 1;
+}
+
+void mux_vbl() {
+	mux_frame_t *front = &mux_frames[mux_front];
+
+	/* report on the frame that just finished */
+	mux_report.count = front->submitted;
+	mux_report.drop_oam = front->drop_oam;
+	mux_report.drop_hbl = mux_late;
+
+	if (mux_ready) {
+		mux_front ^= 1;
+		front = &mux_frames[mux_front];
+		mux_ready = 0;
+	}
+
+	/* first band goes in now, leftovers from last frame are hidden */
+	OBJ_ATTR *set = &oam_mem[MUX_OAM_BASE];
+	obj_copy(set, front->bands[0], front->counts[0]);
+	obj_hide_multi(&set[front->counts[0]], MUX_SETS * MUX_SET_SIZE - front->counts[0]);
+
+	/* hblank isr writes the band after the one being displayed */
+	mux_target = 1;
+	mux_written = 0;
+	mux_late = 0;
+}
+
+void mux_latch() {
+	const mux_frame_t *front = &mux_frames[mux_front];
+	OBJ_ATTR *set = &oam_mem[MUX_OAM_BASE];
+
+	for (int i = 0; i < front->counts[0]; i++) {
+		set[i].attr0 = mux_latch_attr0(front->bands[0][i].attr0);
+		set[i].attr1 = mux_latch_attr1(front->bands[0][i].attr1, front->inv_lambda[0][i]);
+	}
+}
@@ -0,0 +1,73 @@
+#ifndef OBJMUX_H_
+#define OBJMUX_H_
+
+#include <tonc.h>
+
+#include "mode7.h"
+
+/* oam above the mode 7 objects is split into three sets that take turns
+   holding a band: band b+1 is written into its set while band b displays.
+   sprites can't be taller than a band, so a set is always free again by
+   the time it is rewritten. the latched pitch moves sprites up to
+   M7_LATCH_MAX_ROWS lines either way, so writes start that many lines into
+   a band: late enough for the set's last sprites to be done, and with
+   MUX_SET_SIZE / MUX_HBL_WRITES lines of writes still early enough */
+#define MUX_OAM_BASE M7_OBJ_COUNT
+#define MUX_SETS 3
+#define MUX_SET_SIZE ((128 - MUX_OAM_BASE) / MUX_SETS)
+
+#define MUX_BAND_SHIFT 5
+#define MUX_BAND_HEIGHT (1 << MUX_BAND_SHIFT)
+#define MUX_BANDS (SCREEN_HEIGHT / MUX_BAND_HEIGHT)
+
+#define MUX_HBL_WRITES 2 /* oam entries written per hblank */
+
+typedef struct {
+	u16 count; /* sprites submitted */
+	u16 drop_oam; /* band set was full or sprite too tall */
+	u16 drop_hbl; /* not written before its band started */
+} mux_report_t;
+
+typedef struct {
+	OBJ_ATTR bands[MUX_BANDS][MUX_SET_SIZE];
+	FIXED inv_lambda[MUX_BANDS][MUX_SET_SIZE]; /* for the late strafe */
+	u8 counts[MUX_BANDS];
+	u16 submitted, drop_oam;
+} mux_frame_t;
+
+/* report for the last displayed frame */
+extern mux_report_t mux_report;
+
+/* accessible both from objmux and iwram */
+extern mux_frame_t mux_frames[2];
+extern int mux_front;
+extern int mux_target, mux_written, mux_late;
+
+/* building the next frame */
+void mux_begin();
+void mux_add(const OBJ_ATTR *obj, FIXED inv_lambda);
+void mux_end();
+
+/* start of vblank: swap in the finished frame and write the first band */
+void mux_vbl();
+
+/* after the late latch: move the first band with it, the hblank isr moves
+   the rest as it writes them */
+void mux_latch();
+
+INLINE u16 mux_latch_attr0(u16 attr0) {
+	int y = BFN_GET(attr0, ATTR0_Y) - m7_latch.rows;
+	BFN_SET(attr0, y, ATTR0_Y);
+	return attr0;
+}
+
+INLINE u16 mux_latch_attr1(u16 attr1, FIXED inv_lambda) {
+	int x = BFN_GET(attr1, ATTR1_X) - fx2int(fxmul(m7_latch.dx, inv_lambda));
+	BFN_SET(attr1, x, ATTR1_X);
+	return attr1;
+}
+
+/* called from the hblank isr */
+IWRAM_CODE void mux_hbl(int vc);
+
+#endif
@@ -0,0 +1,40 @@
+#include <tonc.h>
+
+#include "objmux.h"
+
+IWRAM_CODE void
+mux_hbl(int vc) {
+	int line = vc + 1;
+	if (line >= SCREEN_HEIGHT) {
+		return;
+	}
+
+	const mux_frame_t *front = &mux_frames[mux_front];
+	int target = (MAX(line - M7_LATCH_MAX_ROWS, 0) >> MUX_BAND_SHIFT) + 1;
+
+	/* band that just started had to be complete, whatever is left is dropped */
+	if (target != mux_target) {
+		mux_late += front->counts[mux_target] - mux_written;
+		mux_target = target;
+		mux_written = 0;
+	}
+	if (target >= MUX_BANDS) {
+		return;
+	}
+
+	int n = front->counts[target] - mux_written;
+	if (n > MUX_HBL_WRITES) {
+		n = MUX_HBL_WRITES;
+	}
+
+	/* attributes only, the fill halfword belongs to the object matrices */
+	const OBJ_ATTR *src = &front->bands[target][mux_written];
+	const FIXED *inv_lambda = &front->inv_lambda[target][mux_written];
+	OBJ_ATTR *dst = &oam_mem[MUX_OAM_BASE + (target % MUX_SETS) * MUX_SET_SIZE + mux_written];
+	for (int i = 0; i < n; i++) {
+		dst[i].attr0 = mux_latch_attr0(src[i].attr0);
+		dst[i].attr1 = mux_latch_attr1(src[i].attr1, inv_lambda[i]);
+		dst[i].attr2 = src[i].attr2;
+	}
+	mux_written += n;
+}
@@ -0,0 +1,61 @@
+#include <tonc.h>
+
+#include "profile.h"
+
+u32 prof_acc[PROF_COUNT];
+
+static u32 prof_hist[PROF_COUNT][PROF_FRAMES];
+static int prof_head;
+static int prof_row; /* overlay row drawn next */
+
+static const char *const prof_names[PROF_COUNT] = {
+	"input", "cam", "ray", "aff", "win", "obj", "isr"
+};
+
+void prof_init() {
+	profile_start();
+
+	for (int s = 0; s < PROF_COUNT; s++) {
+		prof_acc[s] = 0;
+		for (int i = 0; i < PROF_FRAMES; i++) {
+			prof_hist[s][i] = 0;
+		}
+	}
+	prof_head = 0;
+	prof_row = 0;
+}
+
+void prof_frame() {
+	for (int s = 0; s < PROF_COUNT; s++) {
+		prof_hist[s][prof_head] = prof_acc[s];
+		prof_acc[s] = 0;
+	}
+	prof_head = (prof_head + 1) % PROF_FRAMES;
+}
+
+void prof_stat(prof_section_t section, prof_stat_t *stat) {
+	const u32 *hist = prof_hist[section];
+	u32 sum = 0;
+
+	stat->min = 0xFFFFFFFF;
+	stat->max = 0;
+	for (int i = 0; i < PROF_FRAMES; i++) {
+		stat->min = MIN(stat->min, hist[i]);
+		stat->max = MAX(stat->max, hist[i]);
+		sum += hist[i];
+	}
+	stat->avg = sum / PROF_FRAMES;
+}
+
+void prof_draw() {
+	/* one row per call, the rest of the overlay is left as it was */
+	prof_stat_t stat;
+	prof_stat(prof_row, &stat);
+
+	int y = PROF_OVERLAY_Y + prof_row * 8;
+	tte_erase_rect(8, y, SCREEN_WIDTH - 8, y + 8);
+	tte_printf("#{P:8,%d}%-5s%7d%7d%7d", y, prof_names[prof_row],
+		stat.min, stat.avg, stat.max);
+
+	prof_row = (prof_row + 1) % PROF_COUNT;
+}
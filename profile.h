@@ -0,0 +1,62 @@
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <tonc.h>
+
+/* cycle counts per subsystem, summed over a frame and kept for the last
+   PROF_FRAMES frames. timers 2 and 3 are started once by profile_start and
+   left running, sections read the 32 bit count at both ends. isr time
+   is only counted in PROF_ISR, not in the sections the isrs interrupted */
+// #define PROF_ENABLED
+
+#define PROF_FRAMES 32 /* rolling window, frames */
+#define PROF_OVERLAY_Y 48 /* first overlay row on bg0, pixels */
+
+typedef enum {
+	PROF_INPUT,
+	PROF_CAMERA,
+	PROF_RAYCAST, /* m7_prep_lines phases */
+	PROF_AFFINE,
+	PROF_WINDOW,
+	PROF_OBJECTS,
+	PROF_ISR, /* all isrs */
+	PROF_COUNT
+} prof_section_t;
+
+typedef struct {
+	u32 min, avg, max;
+} prof_stat_t;
+
+extern u32 prof_acc[PROF_COUNT]; /* this frame so far */
+
+INLINE u32 prof_now() {
+	u32 hi, lo;
+
+	/* re-read if the low half wrapped in between */
+	do {
+		hi = REG_TM3D;
+		lo = REG_TM2D;
+	} while (hi != REG_TM3D);
+	return (hi << 16) | lo;
+}
+
+/* the clock less all isr time so far, volatile as isrs add to it */
+INLINE u32 prof_now_own() {
+	return prof_now() - *(volatile u32*)&prof_acc[PROF_ISR];
+}
+
+#ifdef PROF_ENABLED
+#define PROF_BEGIN(t) u32 t = prof_now_own()
+#define PROF_END(section, t) (prof_acc[section] += prof_now_own() - (t))
+#else
+#define PROF_BEGIN(t)
+#define PROF_END(section, t)
+#endif
+
+/* profiler functions */
+void prof_init();
+void prof_frame();
+void prof_stat(prof_section_t section, prof_stat_t *stat);
+void prof_draw();
+
+#endif
@@ -0,0 +1,98 @@
+#include <tonc.h>
+
+#include "tilecache.h"
+
+typedef struct {
+	const TILE *src; /* key, NULL if free */
+	u16 stamp; /* frame of last use */
+	u8 refs;
+	u8 ready : 1, queued : 1;
+} tc_entry_t;
+
+static tc_entry_t tc_entries[TC_BLOCK_COUNT];
+
+/* blocks waiting for upload */
+static u8 tc_queue[TC_BLOCK_COUNT];
+static int tc_queue_head, tc_queue_len;
+
+static u16 tc_frame;
+
+static void tc_enqueue(int block) {
+	tc_entry_t *e = &tc_entries[block];
+	if (e->queued) {
+		return;
+	}
+
+	tc_queue[(tc_queue_head + tc_queue_len) % TC_BLOCK_COUNT] = block;
+	tc_queue_len++;
+	e->queued = 1;
+}
+
+int tc_acquire(const TILE *src) {
+	int victim = TC_NONE;
+	int victim_age = -1;
+
+	for (int i = 0; i < TC_BLOCK_COUNT; i++) {
+		tc_entry_t *e = &tc_entries[i];
+
+		/* already resident or on its way */
+		if (e->src == src) {
+			e->refs++;
+			e->stamp = tc_frame;
+			return i;
+		}
+
+		/* prefer free blocks, then the least recently used unreferenced one */
+		if (e->refs == 0) {
+			int age = (e->src == NULL) ? 0x10000 : (u16)(tc_frame - e->stamp);
+			if (age > victim_age) {
+				victim = i;
+				victim_age = age;
+			}
+		}
+	}
+
+	/* everything is in use */
+	if (victim == TC_NONE) {
+		return TC_NONE;
+	}
+
+	tc_entry_t *e = &tc_entries[victim];
+	e->src = src;
+	e->refs = 1;
+	e->stamp = tc_frame;
+	e->ready = 0;
+	tc_enqueue(victim);
+
+	return victim;
+}
+
+void tc_release(int block) {
+	tc_entries[block].refs--;
+}
+
+void tc_touch(int block) {
+	tc_entries[block].stamp = tc_frame;
+}
+
+int tc_ready(int block) {
+	return tc_entries[block].ready;
+}
+
+void tc_flush(int budget) {
+	while ((tc_queue_len > 0) && (budget >= TC_BLOCK_TILES)) {
+		int block = tc_queue[tc_queue_head];
+		tc_queue_head = (tc_queue_head + 1) % TC_BLOCK_COUNT;
+		tc_queue_len--;
+
+		tc_entry_t *e = &tc_entries[block];
+		e->queued = 0;
+
+		dma3_cpy(&tile_mem_obj[0][tc_tile_id(block)], e->src, TC_BLOCK_TILES * sizeof(TILE));
+		e->ready = 1;
+
+		budget -= TC_BLOCK_TILES;
+	}
+
+	tc_frame++;
+}
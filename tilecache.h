@@ -0,0 +1,24 @@
+#ifndef TILECACHE_H_
+#define TILECACHE_H_
+
+#include <tonc.h>
+
+/* obj vram is handed out in fixed blocks of one sprite frame each.
+   mode 2 is a tiled mode, so all 32KB of obj vram is available */
+#define TC_BLOCK_TILES 16 /* 4bpp 32x32 */
+#define TC_STATIC_BLOCKS 1 /* kept at the top for always-resident tiles */
+#define TC_BLOCK_COUNT (1024 / TC_BLOCK_TILES - TC_STATIC_BLOCKS)
+#define TC_NONE 0xFF
+
+#define TC_VBL_TILES 64 /* upload budget per vblank */
+
+/* cache functions */
+int tc_acquire(const TILE *src);
+void tc_release(int block);
+void tc_touch(int block);
+int tc_ready(int block);
+void tc_flush(int budget);
+
+INLINE int tc_tile_id(int block) { return block * TC_BLOCK_TILES; }
+
+#endif
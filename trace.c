@@ -0,0 +1,62 @@
+#include <tonc.h>
+
+#include "trace.h"
+
+EWRAM_DATA tr_ring_t tr_ring;
+tr_record_t tr_cur;
+
+static u32 tr_sent; /* records flushed to the debug log */
+static int tr_open; /* tr_cur has been started */
+
+static const char tr_hex[16] = "0123456789abcdef";
+
+void tr_init() {
+	/* the clock stamps are read from */
+	profile_start();
+
+	tr_ring.magic = TR_MAGIC;
+	tr_ring.version = TR_VERSION;
+	tr_ring.record_size = sizeof(tr_record_t);
+	tr_ring.ring = TR_RING;
+	tr_ring.head = 0;
+	tr_sent = 0;
+	tr_open = 0;
+}
+
+void tr_begin(u32 frame) {
+	tr_cur = (tr_record_t){0};
+	tr_cur.frame = frame;
+	TR_MARK(TR_VBLANK);
+	tr_open = 1;
+}
+
+void tr_commit() {
+	if (!tr_open) {
+		return;
+	}
+
+	tr_ring.records[tr_ring.head % TR_RING] = tr_cur;
+	tr_ring.head++;
+	tr_open = 0;
+}
+
+void tr_flush() {
+	/* records that were overwritten before they went out are lost */
+	if (tr_ring.head - tr_sent > TR_RING) {
+		tr_sent = tr_ring.head - TR_RING;
+	}
+
+	for (int n = 0; (n < TR_FLUSH_MAX) && (tr_sent != tr_ring.head); n++, tr_sent++) {
+		const u8 *src = (const u8*)&tr_ring.records[tr_sent % TR_RING];
+
+		/* "M7TR " and the record in hex, bytes in memory order */
+		char *dst = nocash_buffer;
+		*dst++ = 'M'; *dst++ = '7'; *dst++ = 'T'; *dst++ = 'R'; *dst++ = ' ';
+		for (int i = 0; i < sizeof(tr_record_t); i++) {
+			*dst++ = tr_hex[src[i] >> 4];
+			*dst++ = tr_hex[src[i] & 15];
+		}
+		*dst = '\0';
+		nocash_message();
+	}
+}
@@ -0,0 +1,67 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <tonc.h>
+
+#include "profile.h"
+
+/* one fixed size record per frame, kept in an ewram ring. the host reads
+   them from a memory dump (find the magic) or from the no$gba debug log,
+   where tr_flush sends each as a line of hex. gfx/trace.py decodes both */
+// #define TRACE_ENABLED
+
+#define TR_MAGIC 0x5254374D /* "M7TR" */
+#define TR_VERSION 3
+#define TR_RING 64 /* records */
+#define TR_FLUSH_MAX 2 /* records sent to the debug log per frame */
+
+/* stamps on the profile.h cycle clock, in frame order */
+typedef enum {
+	TR_VBLANK, /* woke up for vblank */
+	TR_SIM, /* vblank work done */
+	TR_PREP, /* block window and tables */
+	TR_OBJECTS, /* objects, hud and anything after */
+	TR_END,
+	TR_PHASES
+} tr_phase_t;
+
+/* 32 bytes, matches gfx/trace.py */
+typedef struct {
+	u32 frame; /* vblank count */
+	u32 stamps[TR_PHASES];
+	u16 dda_steps; /* raycast steps, both layers */
+	u16 race_late; /* m7_race.late, running total */
+	u8 ticks; /* sim ticks run */
+	u8 path; /* fly.h path from 1, 0 when not flying */
+	u8 hbl_late; /* m7_hbl_report.late for the last frame, M7_HBL_MONITOR only */
+	u8 pad;
+} tr_record_t;
+
+typedef struct {
+	u32 magic;
+	u16 version, record_size;
+	u16 ring, pad;
+	u32 head; /* records written so far, the next goes in head % ring */
+	tr_record_t records[TR_RING];
+} tr_ring_t;
+
+extern tr_ring_t tr_ring;
+extern tr_record_t tr_cur; /* frame being recorded */
+
+#ifdef TRACE_ENABLED
+#define TR_MARK(phase) (tr_cur.stamps[phase] = prof_now())
+#define TR_ADD(field, n) (tr_cur.field += (n))
+#define TR_SET(field, v) (tr_cur.field = (v))
+#else
+#define TR_MARK(phase)
+#define TR_ADD(field, n)
+#define TR_SET(field, v)
+#endif
+
+/* trace functions */
+void tr_init();
+void tr_begin(u32 frame);
+void tr_commit();
+void tr_flush();
+
+#endif